@@ -108,8 +108,8 @@ protected:
     bool block_empty, block_full;
     int cap, thres;
     Container<T> queue;
-private:
     mutable QReadWriteLock lock; //locker in const func
+private:
     QReadWriteLock block_change_lock;
     QWaitCondition cond_full, cond_empty;
     //upto_threshold_callback, downto_threshold_callback
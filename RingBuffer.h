@@ -0,0 +1,119 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QAtomicInteger>
+
+/*!
+ * \brief RingBuffer
+ * bounded lock-free multi producer / multi consumer queue (D. Vyukov).
+ * push() and pop() never block: push() fails when the buffer is full and
+ * pop() fails when it is empty, the caller decides what to do.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+    /*!
+     * \param capacity rounded up to a power of two
+     */
+    explicit RingBuffer(int capacity = 4096);
+    ~RingBuffer();
+
+    bool push(const T& t);
+    bool pop(T& t);
+    int capacity() const { return int(mask + 1); }
+    // approximate, may be stale as soon as it returns
+    int size() const;
+
+private:
+    Q_DISABLE_COPY(RingBuffer)
+
+    struct Cell
+    {
+        QAtomicInteger<quint32> seq;
+        T data;
+    };
+    Cell* cells;
+    quint32 mask;
+    // keep producers and consumers on separate cache lines
+    char pad0[64];
+    QAtomicInteger<quint32> enqueue_pos;
+    char pad1[64];
+    QAtomicInteger<quint32> dequeue_pos;
+    char pad2[64];
+};
+
+template <typename T>
+RingBuffer<T>::RingBuffer(int capacity)
+{
+    quint32 n = 2;
+    while (n < quint32(capacity))
+        n <<= 1;
+    mask = n - 1;
+    cells = new Cell[n];
+    for (quint32 i = 0; i < n; ++i)
+        cells[i].seq.store(i);
+    enqueue_pos.store(0);
+    dequeue_pos.store(0);
+}
+
+template <typename T>
+RingBuffer<T>::~RingBuffer()
+{
+    delete[] cells;
+}
+
+template <typename T>
+bool RingBuffer<T>::push(const T& t)
+{
+    Cell* cell;
+    quint32 pos = enqueue_pos.load();
+    for (;;) {
+        cell = &cells[pos & mask];
+        quint32 seq = cell->seq.loadAcquire();
+        qint32 dif = qint32(seq - pos);
+        if (dif == 0) {
+            if (enqueue_pos.testAndSetRelaxed(pos, pos + 1, pos))
+                break;
+        } else if (dif < 0) {
+            return false; //full
+        } else {
+            pos = enqueue_pos.load();
+        }
+    }
+    cell->data = t;
+    cell->seq.storeRelease(pos + 1);
+    return true;
+}
+
+template <typename T>
+bool RingBuffer<T>::pop(T& t)
+{
+    Cell* cell;
+    quint32 pos = dequeue_pos.load();
+    for (;;) {
+        cell = &cells[pos & mask];
+        quint32 seq = cell->seq.loadAcquire();
+        qint32 dif = qint32(seq - (pos + 1));
+        if (dif == 0) {
+            if (dequeue_pos.testAndSetRelaxed(pos, pos + 1, pos))
+                break;
+        } else if (dif < 0) {
+            return false; //empty
+        } else {
+            pos = dequeue_pos.load();
+        }
+    }
+    t = cell->data;
+    cell->data = T(); // release shared payloads early
+    cell->seq.storeRelease(pos + mask + 1);
+    return true;
+}
+
+template <typename T>
+int RingBuffer<T>::size() const
+{
+    return int(enqueue_pos.load() - dequeue_pos.load());
+}
+
+#endif // RINGBUFFER_H
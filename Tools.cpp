@@ -7,7 +7,304 @@
 #include <QDir>
 #include <QDateTime>
 #include <QDomDocument>
+#include <QDataStream>
 #include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include "copytrace.h"
+#include "BlockingQueue.h"
+#include "fasthash.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <winioctl.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/xattr.h>
+#include <string.h>
+#include <fcntl.h>
+#endif
+
+//Сļ, ļֿ齻ÿĿд߳
+static const qint64 kTeeInMemoryBytes = 4 * 1024 * 1024;
+static const qint64 kTeeChunkBytes = 1024 * 1024;
+static const int kTeeQueuedChunks = 4;
+//У鲻һʱԴ
+static const int kVerifyRetries = 2;
+//дʱļ, ɺ滻Ŀ
+static const char kPartSuffix[] = ".part";
+static QAtomicInt s_verifyCopies(0);
+static QAtomicInt s_copyXattrs(0);
+
+void CTools::setVerifyCopies(bool verify)
+{
+	s_verifyCopies.store(verify ? 1 : 0);
+}
+
+bool CTools::verifyCopies()
+{
+	return s_verifyCopies.load() != 0;
+}
+
+void CTools::setCopyXattrs(bool copy)
+{
+	s_copyXattrs.store(copy ? 1 : 0);
+}
+
+bool CTools::copyXattrs()
+{
+	return s_copyXattrs.load() != 0;
+}
+
+//߶д, hash ΪʱͬʱԴݵУֵ
+static bool streamCopy(QFile& source, QFile& dest, quint64* hash)
+{
+	XxHash64 state;
+	while (!source.atEnd())
+	{
+		QByteArray chunk = source.read(kTeeChunkBytes);
+		if (chunk.isEmpty())
+			return false;
+		if (hash)
+			state.update(chunk.constData(), chunk.size());
+		if (dest.write(chunk) != chunk.size())
+			return false;
+	}
+	if (hash)
+		*hash = state.digest();
+	return true;
+}
+
+//ݵһ, ϡļĿնڸ֮
+struct DataRange
+{
+	qint64 Offset;
+	qint64 Length;
+};
+
+//ѯԴļݵ,  false ʱϡļ޷ѯ, ͨļ
+static bool dataRanges(QFile& source, qint64 size, QVector<DataRange>& ranges)
+{
+	ranges.clear();
+#ifdef Q_OS_WIN
+	HANDLE h = (HANDLE)_get_osfhandle(source.handle());
+	BY_HANDLE_FILE_INFORMATION info;
+	if (!GetFileInformationByHandle(h, &info) || !(info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE))
+		return false;
+	FILE_ALLOCATED_RANGE_BUFFER query;
+	query.FileOffset.QuadPart = 0;
+	query.Length.QuadPart = size;
+	FILE_ALLOCATED_RANGE_BUFFER found[64];
+	while (true)
+	{
+		DWORD bytes = 0;
+		BOOL done = DeviceIoControl(h, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+			found, sizeof(found), &bytes, nullptr);
+		if (!done && GetLastError() != ERROR_MORE_DATA)
+			return false;
+		int count = int(bytes / sizeof(found[0]));
+		for (int i = 0; i < count; i++)
+		{
+			DataRange range;
+			range.Offset = found[i].FileOffset.QuadPart;
+			range.Length = found[i].Length.QuadPart;
+			ranges << range;
+		}
+		if (done)
+			break;
+		if (count == 0)
+			return false;
+		query.FileOffset.QuadPart = ranges.last().Offset + ranges.last().Length;
+		query.Length.QuadPart = size - query.FileOffset.QuadPart;
+	}
+	//ϡԵȫļͨļ
+	return !(ranges.size() == 1 && ranges.first().Offset == 0 && ranges.first().Length == size);
+#elif defined(SEEK_HOLE)
+	int fd = source.handle();
+	qint64 offset = 0;
+	bool ok = true;
+	while (offset < size)
+	{
+		off_t data = lseek(fd, offset, SEEK_DATA);
+		if (data < 0)
+		{
+			//ENXIO: ֮ǿն
+			ok = errno == ENXIO;
+			break;
+		}
+		off_t hole = lseek(fd, data, SEEK_HOLE);
+		if (hole < 0)
+		{
+			ok = false;
+			break;
+		}
+		DataRange range;
+		range.Offset = data;
+		range.Length = qMin<qint64>(hole, size) - data;
+		ranges << range;
+		offset = hole;
+	}
+	//QFile ¼λΪ 0, λҪԭ
+	lseek(fd, 0, SEEK_SET);
+	bool dense = ranges.size() == 1 && ranges.first().Offset == 0 && ranges.first().Length == size;
+	return ok && !dense;
+#else
+	Q_UNUSED(source);
+	Q_UNUSED(size);
+	return false;
+#endif
+}
+
+static void hashZeros(XxHash64& state, qint64 length)
+{
+	if (length <= 0)
+		return;
+	QByteArray zeros(int(qMin(length, kTeeChunkBytes)), 0);
+	for (qint64 left = length; left > 0; left -= zeros.size())
+		state.update(zeros.constData(), qMin<qint64>(left, zeros.size()));
+}
+
+//ֻݵ, նĿ, ĩβ resize . ն 0 Уֵ
+static bool sparseCopy(QFile& source, QFile& dest, const QVector<DataRange>& ranges,
+	qint64 size, quint64* hash)
+{
+	TRACE_SCOPE("sparseCopy");
+#ifdef Q_OS_WIN
+	DWORD bytes = 0;
+	//ʧʱնᱻд 0, Ȼȷ
+	DeviceIoControl((HANDLE)_get_osfhandle(dest.handle()), FSCTL_SET_SPARSE, nullptr, 0,
+		nullptr, 0, &bytes, nullptr);
+#endif
+	XxHash64 state;
+	qint64 hashed = 0;
+	for each (const DataRange& range in ranges)
+	{
+		if (hash)
+			hashZeros(state, range.Offset - hashed);
+		if (!source.seek(range.Offset) || !dest.seek(range.Offset))
+			return false;
+		for (qint64 left = range.Length; left > 0;)
+		{
+			QByteArray chunk = source.read(qMin(left, kTeeChunkBytes));
+			if (chunk.isEmpty())
+				return false;
+			if (hash)
+				state.update(chunk.constData(), chunk.size());
+			if (dest.write(chunk) != chunk.size())
+				return false;
+			left -= chunk.size();
+		}
+		hashed = range.Offset + range.Length;
+	}
+	if (hash)
+		hashZeros(state, size - hashed);
+	if (!dest.resize(size))
+		return false;
+	if (hash)
+		*hash = state.digest();
+	return true;
+}
+
+//ʱļ滻Ŀ, ĿʱҲֻһε
+bool CTools::replaceFile(const QString& from, const QString& to)
+{
+#ifdef Q_OS_WIN
+	return MoveFileExW((const wchar_t*)QDir::toNativeSeparators(from).utf16(),
+		(const wchar_t*)QDir::toNativeSeparators(to).utf16(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+	return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+//дʱļ, ڴ򿪵ľԪ. hash ΪдݵУֵ. ʧʱɾʱļ
+static bool writePart(const QString& from, const QString& partPath, quint64* hash)
+{
+	TRACE_SCOPE_ARG("writePart", partPath);
+	QFile source(from);
+	QFile part(partPath);
+	if (!source.open(QIODevice::ReadOnly) || !part.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	qint64 size = source.size();
+	QVector<DataRange> ranges;
+	bool copied = dataRanges(source, size, ranges) ? sparseCopy(source, part, ranges, size, hash)
+		: streamCopy(source, part, hash);
+	bool written = copied && CTools::copyFileMetadata(source, part);
+	part.close();
+	if (!written)
+		part.remove();
+	return written;
+}
+
+//дʱļ滻Ŀ.  emCopyError, ɹΪ -1
+static int copyThroughTemp(const QString& from, const QString& to)
+{
+	TRACE_SCOPE_ARG("copyThroughTemp", to);
+	QString partPath = to + kPartSuffix;
+	if (!writePart(from, partPath, nullptr))
+		return CTools::COPY_FAILED;
+	if (!CTools::replaceFile(partPath, to))
+	{
+		QFile::remove(partPath);
+		return CTools::COPY_FAILED;
+	}
+	return -1;
+}
+
+static bool hashFile(const QString& filePath, quint64& hash)
+{
+	TRACE_SCOPE_ARG("hashFile", filePath);
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+#ifdef Q_OS_LINUX
+	//дݻҳ, ٶ, صǴϵ
+	fdatasync(file.handle());
+	posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	XxHash64 state;
+	while (!file.atEnd())
+	{
+		QByteArray chunk = file.read(kTeeChunkBytes);
+		if (chunk.isEmpty())
+			return false;
+		state.update(chunk.constData(), chunk.size());
+	}
+	hash = state.digest();
+	return true;
+}
+
+//ʱļдУ, һº滻Ŀ, һʱ¿.
+//ʧʱĿ걣ԭ.  emCopyError, ɹΪ -1
+static int verifiedCopy(const QString& from, const QString& to, int& retries)
+{
+	TRACE_SCOPE_ARG("verifiedCopy", to);
+	QString partPath = to + kPartSuffix;
+	for (int attempt = 0; attempt <= kVerifyRetries; attempt++)
+	{
+		if (attempt > 0)
+			retries++;
+		quint64 sourceHash = 0;
+		if (!writePart(from, partPath, &sourceHash))
+			return CTools::COPY_FAILED;
+		quint64 partHash = 0;
+		if (hashFile(partPath, partHash) && partHash == sourceHash)
+		{
+			if (CTools::replaceFile(partPath, to))
+				return -1;
+			QFile::remove(partPath);
+			return CTools::COPY_FAILED;
+		}
+	}
+	QFile::remove(partPath);
+	return CTools::VERIFY_FAILED;
+}
 
 CTools::CTools()
 {
@@ -45,46 +342,455 @@ int CTools::CalcNextIndex(int nCount, const QStringList& showLists)
 }
 
 bool CTools::copyFileToPath(QString sourceDir, QString toDir, 
-	QString& errorMsg/*=QString()*/, bool coverFileIfExist /*= true*/)
+	QString& errorMsg/*=QString()*/, bool coverFileIfExist /*= true*/,
+	CopyStats* stats /*= nullptr*/)
 {
+	//copyFileToPath ȥ copyThroughTemp ʱ伴ΪѯļϢʱ
+	TRACE_SCOPE_ARG("copyFileToPath", sourceDir);
+	CopyStats localStats;
+	if (!stats)
+		stats = &localStats;
 	toDir.replace("\\", "/");
 	if (sourceDir == toDir){
+		stats->Skipped = true;
 		return true;
 	}
-	if (!QFile::exists(sourceDir)){
+	//ԴĿѯһ, С޸ʱ䶼ͬʱ
+	FileStamp sourceStamp;
+	if (!fileStamp(sourceDir, sourceStamp)){
 		errorMsg = copyErrorMsg(NON_EXISTENT, sourceDir);
+		stats->Error = NON_EXISTENT;
 		return false;
 	}
-	QFileInfo sourceInfo(sourceDir);
 	QString toDirFile = toDir;
 	toDirFile.append("/");
-	toDirFile.append(sourceInfo.fileName());
-	QDir createfile;
-	bool exist = createfile.exists(toDirFile);
-	if (exist){
-		QFileInfo toInfo(toDirFile);
-		if (toInfo.lastModified() == sourceInfo.lastModified())
+	toDirFile.append(QFileInfo(sourceDir).fileName());
+	FileStamp toStamp;
+	if (fileStamp(toDirFile, toStamp)){
+		if (toStamp == sourceStamp)
 		{//δ£
+			stats->Skipped = true;
 			return true;
 		}
-		if (coverFileIfExist){
-			createfile.remove(toDirFile);
+		if (!coverFileIfExist){
+			errorMsg = copyErrorMsg(COPY_FAILED, sourceDir);
+			stats->Error = COPY_FAILED;
+			return false;
 		}
 	}
 	else
 	{
-		if (!createfile.mkpath(toDir))
+		if (!QDir().mkpath(toDir))
 		{
 			errorMsg = copyErrorMsg(UNABLE_CREATE, toDir);
+			stats->Error = UNABLE_CREATE;
 			return false;
 		}
 	}	
-	if (!QFile::copy(sourceDir, toDirFile))
+	int error = -1;
+	if (verifyCopies())
 	{
-		errorMsg = copyErrorMsg(COPY_FAILED, sourceDir);
+		error = verifiedCopy(sourceDir, toDirFile, stats->Retries);
+	}
+	else
+	{
+		error = copyThroughTemp(sourceDir, toDirFile);
+	}
+	if (error >= 0)
+	{
+		errorMsg = copyErrorMsg(emCopyError(error), sourceDir);
+		stats->Error = error;
+		return false;
+	}
+	stats->Bytes = sourceStamp.Size;
+	return true;
+}
+
+bool CTools::fileStamp(const QString& filePath, FileStamp& stamp)
+{
+#ifdef Q_OS_WIN
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW((const wchar_t*)QDir::toNativeSeparators(filePath).utf16(),
+		GetFileExInfoStandard, &data))
+		return false;
+	stamp.Size = (qint64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	stamp.ModifiedTicks = (qint64(data.ftLastWriteTime.dwHighDateTime) << 32)
+		| data.ftLastWriteTime.dwLowDateTime;
+	stamp.Sparse = (data.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) != 0;
+#else
+	struct stat st;
+	if (stat(QFile::encodeName(filePath).constData(), &st) != 0)
 		return false;
+	stamp.Size = st.st_size;
+	stamp.ModifiedTicks = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	//ĿڴСʱпն
+	stamp.Sparse = qint64(st.st_blocks) * 512 < qint64(st.st_size);
+#endif
+	return true;
+}
+
+#ifdef Q_OS_LINUX
+//չ, ûȨ޵ռ (security.* ) 
+static void copyXattrList(int from, int to)
+{
+	ssize_t size = flistxattr(from, nullptr, 0);
+	if (size <= 0)
+		return;
+	QByteArray names(int(size), 0);
+	size = flistxattr(from, names.data(), names.size());
+	for (const char* name = names.constData(); size > 0 && name < names.constData() + size;
+		name += strlen(name) + 1)
+	{
+		ssize_t length = fgetxattr(from, name, nullptr, 0);
+		if (length < 0)
+			continue;
+		QByteArray value(int(length), 0);
+		length = fgetxattr(from, name, value.data(), value.size());
+		if (length >= 0)
+			fsetxattr(to, name, value.constData(), size_t(length), 0);
 	}
+}
+#endif
+
+bool CTools::copyFileMetadata(QFile& from, QFile& to)
+{
+	to.flush();
+#ifdef Q_OS_WIN
+	//ʱһ, 0 ʾĿĴ͸ʱ
+	HANDLE src = (HANDLE)_get_osfhandle(from.handle());
+	HANDLE dst = (HANDLE)_get_osfhandle(to.handle());
+	FILE_BASIC_INFO info;
+	if (!GetFileInformationByHandleEx(src, FileBasicInfo, &info, sizeof(info)))
+		return false;
+	info.CreationTime.QuadPart = 0;
+	info.ChangeTime.QuadPart = 0;
+	info.FileAttributes &= FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM
+		| FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+	if (info.FileAttributes == 0)
+		info.FileAttributes = FILE_ATTRIBUTE_NORMAL;
+	return SetFileInformationByHandle(dst, FileBasicInfo, &info, sizeof(info)) != FALSE;
+#else
+	struct stat st;
+	if (fstat(from.handle(), &st) != 0)
+		return false;
+	struct timespec times[2];
+	times[0] = st.st_atim;
+	times[1] = st.st_mtim;
+	if (futimens(to.handle(), times) != 0 || fchmod(to.handle(), st.st_mode & 07777) != 0)
+		return false;
+#ifdef Q_OS_LINUX
+	if (copyXattrs())
+		copyXattrList(from.handle(), to.handle());
+#endif
 	return true;
+#endif
+}
+
+QByteArray CTools::fileId(const QString& filePath)
+{
+	QByteArray id;
+#ifdef Q_OS_WIN
+	HANDLE h = CreateFileW((const wchar_t*)QDir::toNativeSeparators(filePath).utf16(), 0,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if (h == INVALID_HANDLE_VALUE)
+		return id;
+	BY_HANDLE_FILE_INFORMATION info;
+	if (GetFileInformationByHandle(h, &info))
+	{
+		QDataStream out(&id, QIODevice::WriteOnly);
+		out << quint32(info.dwVolumeSerialNumber) << quint32(info.nFileIndexHigh)
+			<< quint32(info.nFileIndexLow);
+	}
+	CloseHandle(h);
+#else
+	struct stat st;
+	if (stat(QFile::encodeName(filePath).constData(), &st) == 0)
+	{
+		QDataStream out(&id, QIODevice::WriteOnly);
+		out << quint64(st.st_dev) << quint64(st.st_ino);
+	}
+#endif
+	return id;
+}
+
+//һĿд߳
+class TeeWriter : public QThread
+{
+public:
+	TeeWriter(QFile* file) : m_file(file), m_failed(false)
+	{
+		m_chunks.setCapacity(kTeeQueuedChunks);
+		m_chunks.setThreshold(1);
+	}
+	void put(const QByteArray& chunk) { m_chunks.put(chunk); }
+	bool failed() const { return m_failed; }
+protected:
+	void run()
+	{
+		while (true)
+		{
+			QByteArray chunk = m_chunks.take();
+			if (chunk.isEmpty())
+				break;
+			//ʧܺȡ, ߳
+			if (!m_failed && m_file->write(chunk) != chunk.size())
+				m_failed = true;
+		}
+	}
+private:
+	QFile* m_file;
+	BlockingQueue<QByteArray> m_chunks;
+	bool m_failed;
+};
+
+//һĿʱļԴУֵȽ, һʱ滻Ŀ, һʱ¿
+class VerifyTask : public QRunnable
+{
+public:
+	VerifyTask(const QString& from, const QString& to, quint64 sourceHash, int* error, int* retries)
+		: m_from(from), m_to(to), m_sourceHash(sourceHash), m_error(error), m_retries(retries) {}
+	void run()
+	{
+		QString partPath = m_to + kPartSuffix;
+		quint64 partHash = 0;
+		if (hashFile(partPath, partHash) && partHash == m_sourceHash)
+		{
+			if (!CTools::replaceFile(partPath, m_to))
+			{
+				QFile::remove(partPath);
+				*m_error = CTools::COPY_FAILED;
+			}
+			return;
+		}
+		(*m_retries)++;
+		*m_error = verifiedCopy(m_from, m_to, *m_retries);
+	}
+private:
+	QString m_from;
+	QString m_to;
+	quint64 m_sourceHash;
+	int* m_error;
+	int* m_retries;
+};
+
+bool CTools::copyFileToPaths(const QString& sourceFile, const QStringList& toDirs,
+	QStringList& errorMsgs, QList<CopyStats>& stats, bool coverFileIfExist /*= true*/)
+{
+	TRACE_SCOPE_ARG("copyFileToPaths", sourceFile);
+	errorMsgs.clear();
+	stats.clear();
+	for (int i = 0; i < toDirs.size(); i++)
+	{
+		errorMsgs << QString();
+		stats << CopyStats();
+	}
+	if (toDirs.size() == 1)
+		return copyFileToPath(sourceFile, toDirs.first(), errorMsgs[0], coverFileIfExist, &stats[0]);
+
+	FileStamp sourceStamp;
+	if (!fileStamp(sourceFile, sourceStamp))
+	{
+		for (int i = 0; i < toDirs.size(); i++)
+		{
+			errorMsgs[i] = copyErrorMsg(NON_EXISTENT, sourceFile);
+			stats[i].Error = NON_EXISTENT;
+		}
+		return false;
+	}
+
+	//жǷҪ
+	QString fileName = QFileInfo(sourceFile).fileName();
+	bool ok = true;
+	QList<int> pending;
+	QStringList pendingFiles;
+	for (int i = 0; i < toDirs.size(); i++)
+	{
+		QString toDir = toDirs.at(i);
+		toDir.replace("\\", "/");
+		if (sourceFile == toDir)
+		{
+			stats[i].Skipped = true;
+			continue;
+		}
+		QString toDirFile = toDir + "/" + fileName;
+		FileStamp toStamp;
+		if (fileStamp(toDirFile, toStamp))
+		{
+			if (toStamp == sourceStamp)
+			{//δ£
+				stats[i].Skipped = true;
+				continue;
+			}
+			if (!coverFileIfExist)
+			{
+				errorMsgs[i] = copyErrorMsg(COPY_FAILED, sourceFile);
+				stats[i].Error = COPY_FAILED;
+				ok = false;
+				continue;
+			}
+		}
+		else if (!QDir().mkpath(toDir))
+		{
+			errorMsgs[i] = copyErrorMsg(UNABLE_CREATE, toDir);
+			stats[i].Error = UNABLE_CREATE;
+			ok = false;
+			continue;
+		}
+		pending << i;
+		pendingFiles << toDirFile;
+	}
+	if (pending.isEmpty())
+		return ok;
+	QFile source(sourceFile);
+	bool opened = source.open(QIODevice::ReadOnly);
+	//ȷпնļĿ꿽, ն. ĿڴСҲѹȥص
+	//ļϵͳ, ֻѯ, Բ鵽Ϊ׼
+	bool holes = false;
+	if (opened && sourceStamp.Sparse)
+	{
+		QVector<DataRange> ranges;
+		holes = dataRanges(source, sourceStamp.Size, ranges);
+	}
+	if (pending.size() == 1 || holes)
+	{
+		source.close();
+		for each (int i in pending)
+			ok = copyFileToPath(sourceFile, toDirs.at(i), errorMsgs[i], coverFileIfExist, &stats[i]) && ok;
+		return ok;
+	}
+	if (!opened)
+	{
+		for each (int i in pending)
+		{
+			errorMsgs[i] = copyErrorMsg(COPY_FAILED, sourceFile);
+			stats[i].Error = COPY_FAILED;
+		}
+		return false;
+	}
+	QList<QFile*> outputs;
+	for (int n = 0; n < pending.size(); n++)
+	{
+		QFile* out = new QFile(pendingFiles.at(n) + kPartSuffix);
+		if (!out->open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			delete out;
+			out = nullptr;
+		}
+		outputs << out;
+	}
+
+	//Դļֻһ, дĿ
+	QVector<bool> failed(pending.size(), false);
+	bool readFailed = false;
+	//ԴļʱͬʱУֵ
+	bool verify = verifyCopies();
+	XxHash64 sourceState;
+	{
+		TRACE_SCOPE_ARG("tee", sourceFile);
+		if (sourceStamp.Size <= kTeeInMemoryBytes)
+		{
+			QByteArray data = source.readAll();
+			readFailed = data.size() != sourceStamp.Size;
+			if (verify)
+				sourceState.update(data.constData(), data.size());
+			for (int n = 0; n < outputs.size() && !readFailed; n++)
+				failed[n] = !outputs.at(n) || outputs.at(n)->write(data) != data.size();
+		}
+		else
+		{
+			QList<TeeWriter*> writers;
+			for (int n = 0; n < outputs.size(); n++)
+			{
+				TeeWriter* writer = outputs.at(n) ? new TeeWriter(outputs.at(n)) : nullptr;
+				if (writer)
+					writer->start();
+				writers << writer;
+			}
+			while (!source.atEnd())
+			{
+				QByteArray chunk = source.read(kTeeChunkBytes);
+				if (chunk.isEmpty())
+				{
+					readFailed = true;
+					break;
+				}
+				if (verify)
+					sourceState.update(chunk.constData(), chunk.size());
+				for each (TeeWriter* writer in writers)
+				{
+					if (writer)
+						writer->put(chunk);
+				}
+			}
+			for (int n = 0; n < writers.size(); n++)
+			{
+				TeeWriter* writer = writers.at(n);
+				if (!writer)
+				{
+					failed[n] = true;
+					continue;
+				}
+				writer->put(QByteArray());
+				writer->wait();
+				failed[n] = writer->failed();
+				delete writer;
+			}
+		}
+	}
+
+	//Ԫھ, رպ滻Ŀ. Уʱ VerifyTask Уͨ滻
+	for (int n = 0; n < pending.size(); n++)
+	{
+		QFile* out = outputs.at(n);
+		if (out && !failed[n] && !readFailed)
+			failed[n] = !copyFileMetadata(source, *out);
+		if (out)
+		{
+			out->close();
+			if (failed[n] || readFailed || (!verify && !replaceFile(out->fileName(), pendingFiles.at(n))))
+			{
+				failed[n] = true;
+				out->remove();
+			}
+		}
+		delete out;
+	}
+
+	//ʱļжУ
+	QVector<int> errors(pending.size(), -1);
+	if (verify && !readFailed)
+	{
+		quint64 sourceHash = sourceState.digest();
+		QThreadPool pool;
+		pool.setMaxThreadCount(pending.size());
+		for (int n = 0; n < pending.size(); n++)
+		{
+			if (failed[n])
+				continue;
+			pool.start(new VerifyTask(sourceFile, pendingFiles.at(n), sourceHash,
+				&errors[n], &stats[pending.at(n)].Retries));
+		}
+		pool.waitForDone();
+	}
+
+	for (int n = 0; n < pending.size(); n++)
+	{
+		int i = pending.at(n);
+		//ʧʱĿ걣ԭ, ʱļɾ
+		bool written = !failed[n] && !readFailed;
+		if (!written)
+			errors[n] = COPY_FAILED;
+		if (errors[n] >= 0)
+		{
+			errorMsgs[i] = copyErrorMsg(emCopyError(errors[n]), sourceFile);
+			stats[i].Error = errors[n];
+			ok = false;
+			continue;
+		}
+		stats[i].Bytes = sourceStamp.Size;
+	}
+	return ok;
 }
 
 bool CTools::openXml(QDomDocument& doc,const QString& filePath)
@@ -130,6 +836,9 @@ QString CTools::copyErrorMsg(emCopyError errorType, QString filePath)
 	case ERROR_REGEX:
 		errorMsg = QString::fromLocal8Bit("!\n");
 		break;
+	case VERIFY_FAILED:
+		errorMsg = QString::fromLocal8Bit("Уʧ\n");
+		break;
 	default:
 		break;
 	}
@@ -2,6 +2,7 @@
 #include <QStringList>
 #include <QListWidget>
 class QDomDocument;
+class QFile;
 class CTools
 {
 public:
@@ -11,13 +12,57 @@ public:
 		UNABLE_CREATE,
 		COPY_FAILED,
 		EMPTY_RULE,
-		ERROR_REGEX
+		ERROR_REGEX,
+		VERIFY_FAILED
+	};
+	// details of one copyFileToPath call
+	struct CopyStats
+	{
+		qint64 Bytes;
+		bool Skipped;	// destination already up to date
+		int Error;		// emCopyError, -1 if none
+		int Retries;	// copies repeated after a checksum mismatch
+		CopyStats() : Bytes(0), Skipped(false), Error(-1), Retries(0) {}
 	};
 	CTools();
 	~CTools();
 	static int CalcNextIndex(int nCount, const QStringList& showLists);
 	static 	bool copyFileToPath(QString sourceDir, QString toDir,
-		QString& errorMsg=QString(), bool coverFileIfExist = true);
+		QString& errorMsg=QString(), bool coverFileIfExist = true,
+		CopyStats* stats = nullptr);
+	// copies one source into several directories reading it only once,
+	// errorMsgs and stats get one entry per directory
+	static bool copyFileToPaths(const QString& sourceFile, const QStringList& toDirs,
+		QStringList& errorMsgs, QList<CopyStats>& stats, bool coverFileIfExist = true);
+	// size and last write time at the precision of the file system, the time
+	// is in 100 ns units on Windows and ns elsewhere
+	struct FileStamp
+	{
+		qint64 Size;
+		qint64 ModifiedTicks;
+		bool Sparse;		// may have holes, not part of the comparison
+		FileStamp() : Size(-1), ModifiedTicks(0), Sparse(false) {}
+		bool operator==(const FileStamp& other) const
+		{
+			return Size == other.Size && ModifiedTicks == other.ModifiedTicks;
+		}
+	};
+	// one stat of the path, false if it does not exist
+	static bool fileStamp(const QString& filePath, FileStamp& stamp);
+	// times, permissions and, if enabled, extended attributes of from applied
+	// to to through the open handles, both must be open
+	static bool copyFileMetadata(QFile& from, QFile& to);
+	// renames from over to in one call, also when to exists
+	static bool replaceFile(const QString& from, const QString& to);
+	// volume and file index, stays the same across renames, empty if the
+	// file does not exist
+	static QByteArray fileId(const QString& filePath);
+	// checksum every copy against its source, off by default
+	static void setVerifyCopies(bool verify);
+	static bool verifyCopies();
+	// copy extended attributes as well (Linux only), off by default
+	static void setCopyXattrs(bool copy);
+	static bool copyXattrs();
 	static bool openXml(QDomDocument& doc, const QString& filePath);
     static bool saveXml(QDomDocument& doc, const QString& filePath);
 	static QString copyErrorMsg(emCopyError errorType, QString filePath);
@@ -0,0 +1,194 @@
+#include "archivecopy.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QThread>
+#include <QVector>
+#include "copytrace.h"
+#include <string.h>
+
+static const char kArchiveMagic[4] = { 'A', 'C', 'Z', '1' };
+static const qint64 kArchiveChunkBytes = 4 * 1024 * 1024;
+// fast level, archives are about saving I/O more than the last byte
+static const int kArchiveLevel = 1;
+// larger chunks in a header are a damaged archive
+static const quint32 kArchiveMaxChunkBytes = 256 * 1024 * 1024;
+
+struct ArchiveHeader
+{
+	qint64 SourceSize;
+	qint64 SourceModifiedMs;
+	quint32 ChunkBytes;
+	ArchiveHeader() : SourceSize(-1), SourceModifiedMs(0), ChunkBytes(0) {}
+};
+
+static bool readHeader(QIODevice* device, ArchiveHeader& header)
+{
+	char magic[4];
+	if (device->read(magic, 4) != 4 || memcmp(magic, kArchiveMagic, 4) != 0)
+		return false;
+	QDataStream in(device);
+	in >> header.SourceSize >> header.SourceModifiedMs >> header.ChunkBytes;
+	return in.status() == QDataStream::Ok;
+}
+
+class CompressChunk : public QRunnable
+{
+public:
+	CompressChunk(const QByteArray& raw, QByteArray* out) : m_raw(raw), m_out(out)
+	{
+		setAutoDelete(true);
+	}
+	void run() { *m_out = qCompress(m_raw, kArchiveLevel); }
+private:
+	QByteArray m_raw;
+	QByteArray* m_out;
+};
+
+bool ArchiveCopy::isUpToDate(const QString& archivePath, const QFileInfo& sourceInfo)
+{
+	QFile file(archivePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	ArchiveHeader header;
+	return readHeader(&file, header)
+		&& header.SourceSize == sourceInfo.size()
+		&& header.SourceModifiedMs == sourceInfo.lastModified().toMSecsSinceEpoch();
+}
+
+bool ArchiveCopy::compressFileToPath(const QString& sourceFile, const QString& toDir,
+	QString& errorMsg, CTools::CopyStats* stats)
+{
+	TRACE_SCOPE_ARG("ArchiveCopy::compress", sourceFile);
+	QFileInfo sourceInfo(sourceFile);
+	if (!sourceInfo.exists())
+	{
+		errorMsg = CTools::copyErrorMsg(CTools::NON_EXISTENT, sourceFile);
+		stats->Error = CTools::NON_EXISTENT;
+		return false;
+	}
+	QString dir = QString(toDir).replace("\\", "/");
+	QString archivePath = dir + "/" + sourceInfo.fileName() + archiveSuffix();
+	if (isUpToDate(archivePath, sourceInfo))
+	{
+		stats->Skipped = true;
+		return true;
+	}
+	if (!QDir().mkpath(dir))
+	{
+		errorMsg = CTools::copyErrorMsg(CTools::UNABLE_CREATE, dir);
+		stats->Error = CTools::UNABLE_CREATE;
+		return false;
+	}
+
+	QFile source(sourceFile);
+	QString partPath = archivePath + ".part";
+	QFile out(partPath);
+	if (!source.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		errorMsg = CTools::copyErrorMsg(CTools::COPY_FAILED, sourceFile);
+		stats->Error = CTools::COPY_FAILED;
+		return false;
+	}
+
+	out.write(kArchiveMagic, 4);
+	{
+		QDataStream header(&out);
+		header << qint64(sourceInfo.size())
+			<< qint64(sourceInfo.lastModified().toMSecsSinceEpoch())
+			<< quint32(kArchiveChunkBytes);
+	}
+
+	// a batch holds one chunk per thread, frames are written in order
+	QThreadPool pool;
+	int batchSize = qMax(1, QThread::idealThreadCount());
+	pool.setMaxThreadCount(batchSize);
+	bool ok = true;
+	while (ok && !source.atEnd())
+	{
+		QVector<QByteArray> compressed(batchSize);
+		int chunks = 0;
+		for (; chunks < batchSize && !source.atEnd(); ++chunks)
+		{
+			QByteArray raw = source.read(kArchiveChunkBytes);
+			if (raw.isEmpty())
+			{
+				ok = false;
+				break;
+			}
+			if (sourceInfo.size() <= kArchiveChunkBytes)
+				compressed[chunks] = qCompress(raw, kArchiveLevel);
+			else
+				pool.start(new CompressChunk(raw, &compressed[chunks]));
+		}
+		pool.waitForDone();
+		for (int i = 0; i < chunks && ok; ++i)
+		{
+			QByteArray frame;
+			QDataStream(&frame, QIODevice::WriteOnly) << quint32(compressed.at(i).size());
+			frame += compressed.at(i);
+			ok = out.write(frame) == frame.size();
+		}
+	}
+	qint64 written = out.size();
+	out.close();
+	if (!ok || !CTools::replaceFile(partPath, archivePath))
+	{
+		QFile::remove(partPath);
+		errorMsg = CTools::copyErrorMsg(CTools::COPY_FAILED, sourceFile);
+		stats->Error = CTools::COPY_FAILED;
+		return false;
+	}
+	stats->Bytes = written;
+	return true;
+}
+
+bool ArchiveCopy::extract(const QString& archivePath, const QString& destFile)
+{
+	TRACE_SCOPE_ARG("ArchiveCopy::extract", archivePath);
+	QFile in(archivePath);
+	if (!in.open(QIODevice::ReadOnly))
+		return false;
+	ArchiveHeader header;
+	if (!readHeader(&in, header) || header.SourceSize < 0 || header.ChunkBytes == 0
+		|| header.ChunkBytes > kArchiveMaxChunkBytes)
+		return false;
+	// a frame is never larger than its chunk plus the zlib and qCompress overhead
+	const quint32 maxFrame = header.ChunkBytes + header.ChunkBytes / 16 + 64;
+	QString partPath = destFile + ".part";
+	QFile out(partPath);
+	if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	QDataStream frames(&in);
+	qint64 restored = 0;
+	bool ok = true;
+	while (ok && !in.atEnd())
+	{
+		quint32 length = 0;
+		frames >> length;
+		ok = frames.status() == QDataStream::Ok && length > 0 && length <= maxFrame;
+		if (!ok)
+			break;
+		// a truncated frame is not handed to qUncompress
+		QByteArray frame = in.read(length);
+		ok = frame.size() == int(length);
+		if (!ok)
+			break;
+		QByteArray raw = qUncompress(frame);
+		ok = !raw.isEmpty() && raw.size() <= int(header.ChunkBytes)
+			&& restored + raw.size() <= header.SourceSize
+			&& out.write(raw) == raw.size();
+		restored += raw.size();
+	}
+	out.close();
+	if (!ok || restored != header.SourceSize || !CTools::replaceFile(partPath, destFile))
+	{
+		QFile::remove(partPath);
+		return false;
+	}
+	return true;
+}
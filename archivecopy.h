@@ -0,0 +1,31 @@
+#ifndef ARCHIVECOPY_H
+#define ARCHIVECOPY_H
+
+#include <QString>
+#include "Tools.h"
+
+class QFileInfo;
+
+/// compressed destination of archive rules.
+/// the file is written as <name>.acz:
+///   header  "ACZ1", source size, source mtime (ms), chunk size
+///   frames  compressed length + qCompress output, one per chunk
+/// the header is enough to tell whether the archive is up to date, the
+/// chunks of large files are compressed on several threads.
+class ArchiveCopy
+{
+public:
+	static QString archiveSuffix() { return ".acz"; }
+
+	// same contract as CTools::copyFileToPath, stats->Bytes is the
+	// compressed size written
+	static bool compressFileToPath(const QString& sourceFile, const QString& toDir,
+		QString& errorMsg, CTools::CopyStats* stats);
+	// true if archivePath was made from the current sourceInfo
+	static bool isUpToDate(const QString& archivePath, const QFileInfo& sourceInfo);
+	// restores the original file of archivePath as destFile, false if the
+	// archive is damaged or truncated. destFile is replaced only on success
+	static bool extract(const QString& archivePath, const QString& destFile);
+};
+
+#endif // ARCHIVECOPY_H
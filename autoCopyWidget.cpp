@@ -10,11 +10,25 @@
 #include <QTime>
 #include <QSettings>
 #include <QCloseEvent>
+#include <QTimer>
+#include <QScrollBar>
+#include <QDateTime>
+#include <QThread>
 
 #include "Tools.h"
 #include "autocopyschedule.h"
 #include "autocopy.h"
+#include "copylogmodel.h"
+#include "metricsserver.h"
+#include "copytrace.h"
+#include "archivecopy.h"
 
+// output refresh rate and limits
+static const int kLogFlushIntervalMs = 50;
+static const int kMaxLogEntriesPerFlush = 5000;
+static const int kMaxOutputLines = 500000;
+// more copies to one destination in one flush are shown as a single line
+static const int kCopyBurstThreshold = 8;
 
 
 AutoCopyWidget::AutoCopyWidget(QWidget *parent)
@@ -48,7 +62,8 @@ AutoCopyWidget::AutoCopyWidget(QWidget *parent)
 			SLOT(doOutputErrorNext()));
 	}
 
-	this->ErrorFormat.setForeground(QBrush(Qt::red));
+	m_logModel = new CopyLogModel(this, kMaxOutputLines);
+	ui.Output->setModel(m_logModel);
 	ui.Output->setContextMenuPolicy(Qt::CustomContextMenu);
 	connect(ui.Output, SIGNAL(customContextMenuRequested(const QPoint&)),
 		this, SLOT(doOutputContextMenu(const QPoint&)));
@@ -59,8 +74,29 @@ AutoCopyWidget::AutoCopyWidget(QWidget *parent)
 	// copy 
 	m_copySchedule = new AutoCopySchedule(ui.RuleValues->cacheModel());
 	connect(m_copySchedule, SIGNAL(sig_tipMessage(const QString&)), this, SLOT(tipMessage(const QString&)));
-	connect(m_copySchedule, SIGNAL(sig_copyMsg(const QString&)), this, SLOT(displayCopyMsg(const QString&)));
-	connect(m_copySchedule, SIGNAL(sig_errorMsg(const QString&)), this, SLOT(displayErrorMsg(const QString&)));	
+	m_logTimer = new QTimer(this);
+	m_logTimer->setInterval(kLogFlushIntervalMs);
+	connect(m_logTimer, SIGNAL(timeout()), this, SLOT(flushCopyLog()));
+	m_logTimer->start();
+
+	//ͳ
+	m_statsTimer = new QTimer(this);
+	m_statsTimer->setInterval(1000);
+	connect(m_statsTimer, SIGNAL(timeout()), this, SLOT(refreshStats()));
+	m_metricsServer = nullptr;
+	m_traceStartUs = 0;
+	{
+		QSettings metricsSettings("AutoCopy", "Settings");
+		if (metricsSettings.value("Trace/Enabled", false).toBool())
+			ui.btn_Trace->setChecked(true);
+		int port = metricsSettings.value("Metrics/Port", 0).toInt();
+		if (port > 0)
+		{
+			m_metricsServer = new MetricsServer(m_copySchedule, this);
+			if (!m_metricsServer->listenLocal(quint16(port)))
+				displayErrorMsg(QString("metrics port %1: %2").arg(port).arg(m_metricsServer->errorString()));
+		}
+	}
 
 	QObject::connect(ui.Search, SIGNAL(textChanged(QString)), this,
 		SLOT(setSearchFilter(QString)));
@@ -71,15 +107,12 @@ AutoCopyWidget::AutoCopyWidget(QWidget *parent)
 	connect(ui.RuleValues, &AutoRuleView::sig_addEditedTask, [=](const QString& key)
 	{
 		Q_UNUSED(key);
-		m_copySchedule->resetSchedule();
-		ui.btn_Start->setText(QString::fromLocal8Bit("ʼ"));
-		ui.btn_Check->setEnabled(false);
+		m_copySchedule->updateRules();
 	});
+	//ֻ±仯Ĺ, Ҫ¿ʼ
 	connect(ui.RuleValues, &AutoRuleView::sig_updateSchedule, [=]()
 	{
-		m_copySchedule->resetSchedule();
-		ui.btn_Start->setText(QString::fromLocal8Bit("ʼ"));
-		ui.btn_Check->setEnabled(false);
+		m_copySchedule->updateRules();
 	});
 	ui.btn_Check->setEnabled(false);
 }
@@ -90,6 +123,11 @@ AutoCopyWidget::~AutoCopyWidget()
 	settings.beginGroup("StartPath");
 	settings.setValue("geometry", QVariant(saveGeometry()));
 	settings.setValue("SplitterSizes", ui.splitter->saveState());
+	//˳ǰֹͣ߳, д꿽¼
+	delete m_metricsServer;
+	m_metricsServer = nullptr;
+	delete m_copySchedule;
+	m_copySchedule = nullptr;
 }
 
 void AutoCopyWidget::on_btn_Import_clicked()
@@ -99,15 +137,21 @@ void AutoCopyWidget::on_btn_Import_clicked()
 	if (!fileName.isEmpty())
 	{
 		resetDisplay();
+		AutoCopyGroupList groups;
 		AutoCopyPropertyList& rules = fileName.endsWith("xml") ?
-			m_copySchedule->importFileRules(fileName) : m_copySchedule->importRulesBat(fileName);
+			m_copySchedule->importFileRules(fileName, &groups) : m_copySchedule->importRulesBat(fileName);
 		AutoRuleModel* m = ui.RuleValues->cacheModel();
+		m->setGroups(groups);
+		AutoCopyPropertyList imported;
 		for each (AutoCopyProperty var in rules)
 		{
-			m->insertProperty(var.KeyType, var.ValueType, var.Key.replace("\\", "/"),
-				var.Key, var.Value.toString().replace("\\", "/"),
-				false);
+			var.Key.replace("\\", "/");
+			var.Help = var.Key;
+			var.Value = var.Value.toString().replace("\\", "/");
+			var.Advanced = false;
+			imported << var;
 		}
+		m->insertProperties(imported);
 
 		this->setWindowTitle(QFileInfo(fileName).baseName() + " - " + m_baseTitle);
 		
@@ -124,7 +168,7 @@ void AutoCopyWidget::on_btn_Export_clicked()
 		AutoCopyPropertyList& propertyList = m->properties();
 
 		filePath.endsWith("xml")?
-		m_copySchedule->exportFileRules(filePath, propertyList):
+		m_copySchedule->exportFileRules(filePath, propertyList, m->groups()):
 		m_copySchedule->exportRulesBat(filePath,propertyList);
 
 		this->setWindowTitle(QFileInfo(filePath).baseName() + " - " + m_baseTitle);
@@ -133,7 +177,7 @@ void AutoCopyWidget::on_btn_Export_clicked()
 
 void AutoCopyWidget::on_btn_ClearOutPut_clicked()
 {
-	ui.Output->clear();
+	m_logModel->clear();
 }
 
 void AutoCopyWidget::on_btn_Check_clicked()
@@ -152,20 +196,197 @@ void AutoCopyWidget::on_btn_Start_clicked()
 	ui.btn_Check->setEnabled(true);
 }
 
+void AutoCopyWidget::on_btn_Stats_toggled(bool show)
+{
+	ui.StatsView->setVisible(show);
+	ui.StatsSummary->setVisible(show);
+	if (show)
+	{
+		m_lastStats = m_copySchedule->metricsSnapshot();
+		refreshStats();
+		m_statsTimer->start();
+	}
+	else
+	{
+		m_statsTimer->stop();
+	}
+}
+
+void AutoCopyWidget::on_btn_ExportMetrics_clicked()
+{
+	QString filePath = QFileDialog::getSaveFileName(this, QString::fromLocal8Bit("ָ"),
+		"autocopy.prom", "Prometheus (*.prom *.txt)");
+	if (filePath.isEmpty())
+		return;
+	QFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		displayErrorMsg(CTools::copyErrorMsg(CTools::UNABLE_CREATE, filePath) + filePath);
+		return;
+	}
+	file.write(CopyMetrics::toPrometheus(m_copySchedule->metricsSnapshot()));
+	file.close();
+}
+
+//ѹĿ (.acz) ԭΪԭļ
+void AutoCopyWidget::on_btn_Restore_clicked()
+{
+	QString archivePath = QFileDialog::getOpenFileName(this, QString::fromLocal8Bit("ԭ浵"),
+		QString(), QString("AutoCopy (*%1)").arg(ArchiveCopy::archiveSuffix()));
+	if (archivePath.isEmpty())
+		return;
+	QString suggested = archivePath;
+	suggested.chop(ArchiveCopy::archiveSuffix().size());
+	QString destFile = QFileDialog::getSaveFileName(this, QString::fromLocal8Bit("ļ"), suggested);
+	if (destFile.isEmpty())
+		return;
+	if (ArchiveCopy::extract(archivePath, destFile))
+		displayCopyMsg(QString("Restore %1 \n\t to %2").arg(archivePath).arg(destFile));
+	else
+		displayErrorMsg(QString("Restore %1 failed, the archive is damaged or the file cannot be written").arg(archivePath));
+}
+
+void AutoCopyWidget::on_btn_Trace_toggled(bool enable)
+{
+	CopyTrace* trace = CopyTrace::instance();
+	if (enable)
+	{
+		if (QThread::currentThread()->objectName().isEmpty())
+			QThread::currentThread()->setObjectName("gui thread");
+		trace->clear();
+		m_traceStartUs = trace->nowUs();
+		trace->setEnabled(true);
+		return;
+	}
+	trace->setEnabled(false);
+	qint64 nowUs = trace->nowUs();
+	int recorded = int(qMax(qint64(1), (nowUs - m_traceStartUs + 999999) / 1000000));
+	bool ok = false;
+	int seconds = QInputDialog::getInt(this, QString::fromLocal8Bit(""),
+		QString::fromLocal8Bit(":"), recorded, 1, recorded, 1, &ok);
+	if (!ok)
+		return;
+	QString filePath = QFileDialog::getSaveFileName(this, QString::fromLocal8Bit(""),
+		"autocopy-trace.json", "Chrome trace (*.json)");
+	if (filePath.isEmpty())
+		return;
+	QFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		displayErrorMsg(CTools::copyErrorMsg(CTools::UNABLE_CREATE, filePath) + filePath);
+		return;
+	}
+	file.write(trace->toChromeJson(nowUs - qint64(seconds) * 1000000, nowUs));
+	file.close();
+}
+
+static QStringList statsColumns(const QString& name, const RuleCounters& now,
+	const RuleCounters& last, double seconds)
+{
+	const double mb = 1024.0 * 1024.0;
+	QStringList cols;
+	cols << name
+		<< QString("%L1").arg(now.Files)
+		<< QString::number((now.Files - last.Files) / seconds, 'f', 1)
+		<< QString::number(now.Bytes / mb, 'f', 1)
+		<< QString::number((now.Bytes - last.Bytes) / mb / seconds, 'f', 2)
+		<< QString("%L1").arg(now.Skipped)
+		<< QString("%L1").arg(now.Failures)
+		<< QString::number(now.CopyLatency.quantileUs(0.5) / 1000.0, 'f', 2)
+		<< QString::number(now.CopyLatency.quantileUs(0.99) / 1000.0, 'f', 2);
+	return cols;
+}
+
+void AutoCopyWidget::refreshStats()
+{
+	CopyMetrics::Snapshot snap = m_copySchedule->metricsSnapshot();
+	double seconds = qMax(qint64(1), snap.TakenAtMs - m_lastStats.TakenAtMs) / 1000.0;
+
+	ui.StatsView->setUpdatesEnabled(false);
+	ui.StatsView->clear();
+	QList<QTreeWidgetItem*> items;
+	items << new QTreeWidgetItem(statsColumns(QString::fromLocal8Bit("ȫ"),
+		snap.Total, m_lastStats.Total, seconds));
+	QMap<QString, RuleCounters>::const_iterator it = snap.Rules.constBegin();
+	for (; it != snap.Rules.constEnd(); ++it)
+	{
+		items << new QTreeWidgetItem(statsColumns(it.key(), it.value(),
+			m_lastStats.Rules.value(it.key()), seconds));
+	}
+	ui.StatsView->addTopLevelItems(items);
+	ui.StatsView->setUpdatesEnabled(true);
+
+	QStringList summary;
+	summary << QString("queue %1").arg(snap.QueueDepth)
+		<< QString("event->copy p50 %1 ms, p99 %2 ms")
+		.arg(snap.EventLatency.quantileUs(0.5) / 1000.0, 0, 'f', 2)
+		.arg(snap.EventLatency.quantileUs(0.99) / 1000.0, 0, 'f', 2);
+	QMap<QString, quint64>::const_iterator c = snap.Counters.constBegin();
+	for (; c != snap.Counters.constEnd(); ++c)
+		summary << QString("%1 %L2").arg(c.key()).arg(c.value());
+	ui.StatsSummary->setText(summary.join("   "));
+
+	m_lastStats = snap;
+}
+
 void AutoCopyWidget::displayCopyMsg(const QString& msg)
 {
-	ui.Output->setCurrentCharFormat(this->MessageFormat);
-	QTime time;
-	QString strTime =  time.currentTime().toString();
-	ui.Output->append(strTime + " " +msg);
+	m_copySchedule->copyLog()->post(CopyLogEntry::LOG_MESSAGE, msg);
 }
 
 void AutoCopyWidget::displayErrorMsg(const QString& msg)
 {
-	ui.Output->setCurrentCharFormat(this->ErrorFormat);
-	QTime time;
-	QString strTime = time.currentTime().toString();
-	ui.Output->append(strTime + " " + msg);
+	m_copySchedule->copyLog()->post(CopyLogEntry::LOG_ERROR, msg);
+}
+
+void AutoCopyWidget::flushCopyLog()
+{
+	CopyLogEntryList entries;
+	int dropped = m_copySchedule->copyLog()->drain(entries, kMaxLogEntriesPerFlush);
+	if (entries.isEmpty() && dropped == 0)
+		return;
+
+	//ͬһĿĿϲΪһ
+	QHash<QString, int> copies;
+	for each (const CopyLogEntry& entry in entries)
+	{
+		if (entry.Level == CopyLogEntry::LOG_COPY)
+			copies[entry.Dest]++;
+	}
+
+	CopyLogEntryList lines;
+	QSet<QString> summarized;
+	for each (const CopyLogEntry& entry in entries)
+	{
+		if (entry.Level == CopyLogEntry::LOG_COPY
+			&& copies.value(entry.Dest) > kCopyBurstThreshold)
+		{
+			if (summarized.contains(entry.Dest))
+				continue;
+			summarized.insert(entry.Dest);
+			CopyLogEntry summary = entry;
+			summary.Level = CopyLogEntry::LOG_MESSAGE;
+			summary.Text = QString("%L1 files copied to %2")
+				.arg(copies.value(entry.Dest)).arg(entry.Dest);
+			lines << summary;
+			continue;
+		}
+		lines << entry;
+	}
+	if (dropped > 0)
+	{
+		CopyLogEntry drop;
+		drop.Time = QDateTime::currentMSecsSinceEpoch();
+		drop.Level = CopyLogEntry::LOG_ERROR;
+		drop.Text = QString("%L1 messages dropped").arg(dropped);
+		lines << drop;
+	}
+
+	QScrollBar* bar = ui.Output->verticalScrollBar();
+	bool atBottom = bar->value() == bar->maximum();
+	m_logModel->appendEntries(lines);
+	if (atBottom)
+		ui.Output->scrollToBottom();
 }
 
 void AutoCopyWidget::doOutputContextMenu(QPoint pt)
@@ -178,9 +399,12 @@ void AutoCopyWidget::doOutputFindDialog()
 {
 	QStringList strings(this->FindHistory);
 
-	QString selection = ui.Output->textCursor().selectedText();
-	if (!selection.isEmpty() && !selection.contains(QChar::ParagraphSeparator) &&
+	//ǰеΪĬϲ
+	QString selection = ui.Output->currentIndex().data(Qt::DisplayRole).toString();
+	if (!selection.isEmpty() && !selection.contains('\n') &&
+		!selection.contains(QChar::ParagraphSeparator) &&
 		!selection.contains(QChar::LineSeparator)) {
+		strings.removeAll(selection);
 		strings.push_front(selection);
 	}
 
@@ -209,69 +433,30 @@ void AutoCopyWidget::doOutputFindNext(bool directionForward)
 
 	QString search = this->FindHistory.front();
 
-	QTextCursor textCursor = ui.Output->textCursor();
-	QTextDocument* document = ui.Output->document();
-	QTextDocument::FindFlags flags;
-	if (!directionForward) {
-		flags |= QTextDocument::FindBackward;
-	}
-
-	textCursor = document->find(search, textCursor, flags);
-
-	if (textCursor.isNull()) {
-		// first search found nothing, wrap around and search again
-		textCursor = ui.Output->textCursor();
-		textCursor.movePosition(directionForward ? QTextCursor::Start
-			: QTextCursor::End);
-		textCursor = document->find(search, textCursor, flags);
-	}
-
-	if (textCursor.hasSelection()) {
-		ui.Output->setTextCursor(textCursor);
+	// search from the current line, the log model wraps around
+	QModelIndex current = ui.Output->currentIndex();
+	int from = current.isValid() ? current.row()
+		: (directionForward ? -1 : m_logModel->rowCount());
+	int row = m_logModel->findNext(search, from, directionForward);
+	if (row >= 0) {
+		selectOutputRow(row);
 	}
 }
 
 void AutoCopyWidget::doOutputErrorNext()
 {
-	QTextCursor textCursor = ui.Output->textCursor();
-	bool atEnd = false;
-
-	// move cursor out of current error-block
-	if (textCursor.blockCharFormat() == this->ErrorFormat) {
-		atEnd = !textCursor.movePosition(QTextCursor::NextBlock);
-	}
-
-	// move cursor to next error-block
-	while (textCursor.blockCharFormat() != this->ErrorFormat && !atEnd) {
-		atEnd = !textCursor.movePosition(QTextCursor::NextBlock);
-	}
-
-	if (atEnd) {
-		// first search found nothing, wrap around and search again
-		atEnd = !textCursor.movePosition(QTextCursor::Start);
-
-		// move cursor to next error-block
-		while (textCursor.blockCharFormat() != this->ErrorFormat && !atEnd) {
-			atEnd = !textCursor.movePosition(QTextCursor::NextBlock);
-		}
+	QModelIndex current = ui.Output->currentIndex();
+	int row = m_logModel->nextError(current.isValid() ? current.row() : -1);
+	if (row >= 0) {
+		selectOutputRow(row);
 	}
+}
 
-	if (!atEnd) {
-		textCursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
-
-		QTextCharFormat selectionFormat;
-		selectionFormat.setBackground(Qt::yellow);
-		QTextEdit::ExtraSelection extraSelection = { textCursor, selectionFormat };
-		ui.Output->setExtraSelections(QList<QTextEdit::ExtraSelection>()
-			<< extraSelection);
-
-		// make the whole error-block visible
-		ui.Output->setTextCursor(textCursor);
-
-		// remove the selection to see the extraSelection
-		textCursor.setPosition(textCursor.anchor());
-		ui.Output->setTextCursor(textCursor);
-	}
+void AutoCopyWidget::selectOutputRow(int row)
+{
+	QModelIndex idx = m_logModel->index(row, 0);
+	ui.Output->setCurrentIndex(idx);
+	ui.Output->scrollTo(idx, QAbstractItemView::PositionAtCenter);
 }
 
 void AutoCopyWidget::tipMessage(const QString& msg)
@@ -8,10 +8,14 @@
 #include <QSystemTrayIcon>
 
 #include "ui_autoCopyWidget.h"
+#include "copymetrics.h"
 
 
 class AutoCopySchedule;
 class QFileSystemWatcher;
+class QTimer;
+class CopyLogModel;
+class MetricsServer;
 
 class AutoCopyWidget : public QWidget
 {
@@ -28,6 +32,10 @@ public slots:
 	void on_btn_ClearOutPut_clicked();
 	void on_btn_Check_clicked();
 	void on_btn_Start_clicked();
+	void on_btn_Stats_toggled(bool show);
+	void on_btn_ExportMetrics_clicked();
+	void on_btn_Trace_toggled(bool enable);
+	void on_btn_Restore_clicked();
 	//
 	void tipMessage(const QString& msg);
 	void displayCopyMsg(const QString& msg);
@@ -43,17 +51,25 @@ private slots:
 	void setSearchFilter(const QString& str);
 	void setAdvancedView(bool v);
 	void resetDisplay();
+	//ˢ
+	void flushCopyLog();
+	void selectOutputRow(int row);
+	void refreshStats();
 protected:
 	void changeEvent(QEvent *) override;
 	void closeEvent(QCloseEvent *event) override;
 private:
-	QTextCharFormat ErrorFormat;
-	QTextCharFormat MessageFormat;
 	QStringList FindHistory;
 	AutoCopySchedule* m_copySchedule;
 private:
 	Ui::AutoCopyWidget ui;
 	QMenu* m_OutPutMenu;
+	QTimer* m_logTimer;
+	CopyLogModel* m_logModel;
+	QTimer* m_statsTimer;
+	CopyMetrics::Snapshot m_lastStats;
+	MetricsServer* m_metricsServer;
+	qint64 m_traceStartUs;
 	bool m_bWatching;
 	QString m_baseTitle;
 	QPointer<QSystemTrayIcon> m_trayIcon;
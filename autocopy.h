@@ -25,6 +25,24 @@ struct AutoCopyProperty
 	QStringList Strings;
 	QString Help;
 	bool Advanced;
+	// glob filters applied to paths under Key
+	QStringList Includes;
+	QStringList Excludes;
+	// Value receives compressed archives instead of copies
+	bool Compress;
+	// deletes and renames under Key are repeated in Value
+	bool Mirror;
+	// rule group, nested groups are separated by '/'
+	QString Group;
+	// when changes are copied, see SyncPolicy. empty: from the group
+	QString Policy;
+	// changes are collected and published together with a manifest
+	bool Transaction;
+	// globs giving the publish order of a batch, unlisted files go first
+	QStringList PublishOrder;
+	AutoCopyProperty()
+		: KeyType(STRING), ValueType(STRING), Advanced(false), Compress(false),
+		Mirror(false), Transaction(false) {}
 	bool operator==(const AutoCopyProperty& other) const
 	{
 		return this->Key == other.Key;
@@ -38,6 +56,28 @@ struct AutoCopyProperty
 // list of properties
 typedef QList<AutoCopyProperty> AutoCopyPropertyList;
 
+/// defaults shared by the rules of a group. Name is the full path of the
+/// group, "a/b" is a subgroup of "a" and inherits what it leaves empty
+struct AutoCopyGroup
+{
+	QString Name;
+	// root for relative destinations of the group's rules
+	QString DestRoot;
+	// used by rules without includes of their own
+	QStringList Includes;
+	// added to the excludes of every rule
+	QStringList Excludes;
+	// share of the copy queue relative to the other groups
+	int Weight;
+	// bytes per second for the group and its subgroups, 0 for unlimited
+	qint64 RateLimit;
+	// sync policy of rules without one of their own
+	QString Policy;
+	AutoCopyGroup() : Weight(1), RateLimit(0) {}
+};
+
+typedef QList<AutoCopyGroup> AutoCopyGroupList;
+
 
 // allow QVariant to be a property or list of properties
 Q_DECLARE_METATYPE(AutoCopyProperty)
@@ -6,32 +6,135 @@
 #include <QThreadPool>
 #include <QDebug>
 #include <QDir>
+#include <QSettings>
+#include <QScopedPointer>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QVector>
 #include <fstream>
 #include <sstream>
 
 #include "autocopy.h"
 #include "autoruleview.h"
 #include "Tools.h"
+#include "copyjournal.h"
+#include "copytrace.h"
+#include "contentstore.h"
+#include "archivecopy.h"
+#include "retrywheel.h"
+#include "pollscanner.h"
+#include "fanotifywatcher.h"
+
+//·Ƚ destKey һ, Windows ²ִСд
+#ifdef Q_OS_WIN
+static const Qt::CaseSensitivity kPathCase = Qt::CaseInsensitive;
+#else
+static const Qt::CaseSensitivity kPathCase = Qt::CaseSensitive;
+#endif
+
+//Դ, Ϊʱû
+static QString s_settingsFile;
+
+static QSettings* openSettings()
+{
+	if (s_settingsFile.isEmpty())
+		return new QSettings("AutoCopy", "Settings");
+	return new QSettings(s_settingsFile, QSettings::IniFormat);
+}
+
+//ɨһĿ¼, ĿȽҳڵļ
+struct RescanJob
+{
+	QString Dir;
+	QStringList Stale;
+};
+
+class RescanTask : public QRunnable
+{
+public:
+	RescanTask(AutoCopySchedule* schedule, RescanJob* job) : m_schedule(schedule), m_job(job)
+	{
+		setAutoDelete(true);
+	}
+	void run()
+	{
+		TRACE_SCOPE_ARG("rescan", m_job->Dir);
+		PollScanner::Listing listing;
+		if (!PollScanner::scan(m_job->Dir, listing))
+			return;
+		QDir dir(m_job->Dir);
+		for (PollScanner::Listing::const_iterator it = listing.begin(); it != listing.end(); ++it)
+		{
+			QString path = dir.filePath(it.key());
+			if (!m_schedule->acceptPath(path, false))
+				continue;
+			QList<bool> compress;
+			QStringList dests = m_schedule->checkCopyFile(path, nullptr, &compress);
+			for (int i = 0; i < dests.size(); i++)
+			{
+				if (dests.at(i).isEmpty())
+					continue;
+				QString destFile = QString(dests.at(i)).replace("\\", "/") + "/" + it.key();
+				bool stale;
+				if (compress.at(i))
+				{
+					stale = !ArchiveCopy::isUpToDate(destFile + ArchiveCopy::archiveSuffix(), QFileInfo(path));
+				}
+				else
+				{
+					CTools::FileStamp stamp;
+					stale = !CTools::fileStamp(destFile, stamp) || stamp.Size != it.value().Size
+						|| stamp.ModifiedTicks != it.value().ModifiedTicks;
+				}
+				if (stale)
+				{
+					m_job->Stale << path;
+					break;
+				}
+			}
+		}
+	}
+private:
+	AutoCopySchedule* m_schedule;
+	RescanJob* m_job;
+};
 
 class CopyTask :public QRunnable
 {
 public:
 	CopyTask(AutoCopySchedule* copyThread, const QString& from, AutoCopySchedule::emTaskType eType)
-		:m_copyThread(copyThread), m_from(from), m_taskType(eType){}
+		:m_copyThread(copyThread), m_from(from), m_taskType(eType),
+		m_queuedUs(copyThread->clockUs()),
+		m_traceQueuedUs(CopyTrace::enabled() ? CopyTrace::instance()->nowUs() : -1){}
 	~CopyTask(){}
 protected:
 	virtual void run(){
+		if (m_traceQueuedUs >= 0)
+		{
+			CopyTrace* trace = CopyTrace::instance();
+			trace->record("queue.wait", m_traceQueuedUs, trace->nowUs() - m_traceQueuedUs, m_from);
+		}
 		switch (m_taskType)
 		{
 		case AutoCopySchedule::COPYFILEINIT:
 			m_copyThread->copyExist();
 			break;
 		case AutoCopySchedule::COPYFILETASK:
-			m_copyThread->copyFile(m_from);
+			m_copyThread->copyFile(m_from, m_queuedUs);
 			break;
 		case AutoCopySchedule::UPDATEDIRECTORYTASK:
 			m_copyThread->updateDirFilesWatcher(m_from);
 			break;
+		case AutoCopySchedule::UPDATERULESTASK:
+			m_copyThread->applyRules();
+			break;
+		case AutoCopySchedule::ADDRULETASK:
+			m_copyThread->addRule(m_from);
+			break;
+		case AutoCopySchedule::RESCANTASK:
+			m_copyThread->rescanOverflow();
+			break;
 		default:
 			break;
 		}
@@ -40,62 +143,304 @@ private:
 	AutoCopySchedule* m_copyThread;
 	QString  m_from;
 	AutoCopySchedule::emTaskType m_taskType;
+	qint64 m_queuedUs;
+	qint64 m_traceQueuedUs;
 };
 
 AutoCopySchedule::AutoCopySchedule(AutoRuleModel* model) :
 m_model(model),
-m_fileSysWatcher(nullptr)
+m_fileSysWatcher(nullptr),
+m_journal(nullptr),
+m_store(nullptr),
+m_retries(nullptr),
+m_deferred(nullptr),
+m_poller(nullptr),
+m_fanotify(nullptr)
 {
+	//¼
+	QScopedPointer<QSettings> settingsOwner(openSettings());
+	QSettings& settings = *settingsOwner;
+	settings.beginGroup("Journal");
+	if (settings.value("Enabled", true).toBool())
+	{
+		QString dir = settings.value("Path",
+			QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal").toString();
+		m_journal = new CopyJournal(dir,
+			settings.value("MaxBytes", 16 * 1024 * 1024).toLongLong(),
+			settings.value("Files", 5).toInt());
+	}
+	settings.endGroup();
+	//У
+	CTools::setVerifyCopies(settings.value("Copy/Verify", false).toBool());
+	CTools::setCopyXattrs(settings.value("Copy/Xattrs", false).toBool());
+	//ȥش洢, ĿΪָͬһݵӲ
+	settings.beginGroup("Store");
+	if (settings.value("Enabled", false).toBool())
+	{
+		m_store = new ContentStore(settings.value("Path",
+			QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/store").toString());
+	}
+	settings.endGroup();
+	//ռû򿽱ʧܵļʱ, μӱ
+	settings.beginGroup("Retry");
+	m_retries = new RetryWheel(settings.value("BaseMs", 250).toLongLong(),
+		settings.value("MaxMs", 60000).toLongLong(),
+		settings.value("MaxAttempts", 8).toInt());
+	settings.endGroup();
+	//ͬӺĿ, ֻõʱֵĶʱ
+	m_deferred = new RetryWheel(0, 0, 1);
+	//Ĺû޸ô֮󷢲
+	m_batchQuietMs = settings.value("Batch/QuietMs", 2000).toLongLong();
+	m_clock.start();
+	//, ̫Сʱͨ޸Ҳɨ
+	m_tasksQueue.setCapacity(qMax(16, settings.value("Queue/Capacity", 4096).toInt()));
+	//һͻѿ߳
+	m_tasksQueue.setThreshold(1);
+	setObjectName("copy thread");
 	this->start();
 }
 
+AutoCopySchedule::~AutoCopySchedule()
+{
+	// take еĿ߳, ǰɺ˳
+	requestInterruption();
+	m_tasksQueue.put(QueuedTask(), 0);
+	wait();
+	delete m_fileSysWatcher;
+	m_fileSysWatcher = nullptr;
+	delete m_poller;
+	m_poller = nullptr;
+	delete m_fanotify;
+	m_fanotify = nullptr;
+	//take ڿٵķ鴦ͣ, һȡȫ
+	for each (const QueuedTask& queued in m_tasksQueue.takeAll())
+		delete queued.Task;
+	delete m_journal;
+	delete m_store;
+	delete m_retries;
+	delete m_deferred;
+}
+
+
+void AutoCopySchedule::setSettingsFile(const QString& iniPath)
+{
+	s_settingsFile = iniPath;
+}
 
 void AutoCopySchedule::createWatcher()
 {	
 	if (m_fileSysWatcher)
 	{
-		sig_copyMsg("Auto Copy Working...");
+		m_copyLog.post(CopyLogEntry::LOG_MESSAGE, "Auto Copy Working...");
 		return;
 	}
 	m_fileSysWatcher = new QFileSystemWatcher(this);
 	connect(m_fileSysWatcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(directoryUpdated(const QString &)));
 	connect(m_fileSysWatcher, SIGNAL(fileChanged(const QString &)), this, SLOT(fileUpdated(const QString &)));
+	//̵ղ֪ͨĿ¼ʱɨ. Mode: auto ֻɨԶ̺ FUSE Ŀ¼, always, never
+	QScopedPointer<QSettings> settingsOwner(openSettings());
+	QSettings& settings = *settingsOwner;
+	settings.beginGroup("Poll");
+	QString mode = settings.value("Mode", "auto").toString();
+	if (mode != "never")
+	{
+		m_poller = new PollScanner(settings.value("MinMs", 1000).toLongLong(),
+			settings.value("MaxMs", 30000).toLongLong(), mode == "always", &m_metrics, this);
+		connect(m_poller, SIGNAL(directoryChanged(const QString &)), this, SLOT(directoryUpdated(const QString &)));
+		connect(m_poller, SIGNAL(fileChanged(const QString &)), this, SLOT(fileUpdated(const QString &)));
+	}
+	settings.endGroup();
+	//Backend: fanotify ÿļϵͳһ, Ŀ¼ (Linux, Ҫ CAP_SYS_ADMIN)
+	if (settings.value("Watch/Backend", "auto").toString() == "fanotify")
+	{
+		m_fanotify = new FanotifyWatcher(this);
+		if (m_fanotify->open())
+		{
+			connect(m_fanotify, SIGNAL(directoryChanged(const QString &)), this, SLOT(directoryUpdated(const QString &)));
+			connect(m_fanotify, SIGNAL(fileChanged(const QString &)), this, SLOT(fileUpdated(const QString &)));
+			connect(m_fanotify, SIGNAL(overflowed()), this, SLOT(fanotifyOverflowed()));
+		}
+		else
+		{
+			m_copyLog.post(CopyLogEntry::LOG_ERROR,
+				QString("fanotify unavailable (%1), using per-directory watches").arg(m_fanotify->errorString()));
+			delete m_fanotify;
+			m_fanotify = nullptr;
+		}
+	}
 
+	buildRules();
 	copyFileTask("", COPYFILEINIT);
 }
 
-void AutoCopySchedule::copyExist()
+void AutoCopySchedule::buildRules()
 {
-	AutoCopyPropertyList& rules = m_model->properties();
-	AutoCopyPropertyList fileRules;
-	int nAuto = rules.size();
-	QString src; 
-	//ѡļ
-	for (int i = 0; i < nAuto; i++)
+	QVector<QueueShare> shares;
+	AutoCopyRuleList compiled = compileRules(&shares);
+	m_tasksQueue.setShares(shares);
+	QMutexLocker locker(&m_rulesLock);
+	m_rules = compiled;
+}
+
+AutoCopyRuleList AutoCopySchedule::compileRules(QVector<QueueShare>* shares)
+{
+	//鰴, ϼ¼֮ǰ;  0 иδĹڲ
+	AutoCopyGroupList groups = m_model->groups();
+	qSort(groups.begin(), groups.end(), [](const AutoCopyGroup& a, const AutoCopyGroup& b) {
+		return a.Name < b.Name;
+	});
+	QHash<QString, AutoCopyGroup> groupByName;
+	QHash<QString, int> lanes;
+	QVector<QueueShare> queueShares(1);
+	for each (const AutoCopyGroup& group in groups)
 	{
-		const AutoCopyProperty& pro = rules.at(i);
-		src = pro.Key;
-		
-		QFileInfo srcInfo(src);		
-		if (srcInfo.isDir())
+		if (group.Name.isEmpty() || lanes.contains(group.Name))
+			continue;
+		QueueShare share;
+		share.Name = group.Name;
+		for (QString parent = group.Name.section('/', 0, -2); !parent.isEmpty() && share.Parent < 0;
+			parent = parent.section('/', 0, -2))
+			share.Parent = lanes.value(parent, -1);
+		share.Weight = qMax(1, group.Weight);
+		share.RateLimit = qMax<qint64>(0, group.RateLimit);
+		groupByName.insert(group.Name, group);
+		lanes.insert(group.Name, queueShares.size());
+		queueShares << share;
+	}
+	if (shares)
+		*shares = queueShares;
+
+	AutoCopyRuleList compiled;
+	RuleStore rules = m_model->snapshot();
+	for (int row = 0; row < rules.size(); ++row)
+	{
+		const AutoCopyProperty prop = rules.at(row);
+		//ӽԶϼ, δõȡֵ, ųۼ
+		QList<AutoCopyGroup> chain;
+		for (QString name = prop.Group; !name.isEmpty(); name = name.section('/', 0, -2))
 		{
-			// remove contains
-			if (m_fileOnlyPaths.contains(src))
-				m_fileOnlyPaths.removeOne(src);
+			if (groupByName.contains(name))
+				chain << groupByName.value(name);
 		}
-		else 
+		QString dest = prop.Value.toString();
+		QString policy = prop.Policy;
+		QStringList includes = prop.Includes;
+		QStringList excludes = prop.Excludes;
+		bool rooted = !QDir::isRelativePath(dest);
+		for each (const AutoCopyGroup& group in chain)
 		{
-			QString srcPath = srcInfo.absolutePath();
-			//file only 
-			m_fileOnlyPaths.push_back(srcPath);
-			m_filesInOnlyPath.push_back(src);
-		}		
+			if (!rooted && !group.DestRoot.isEmpty())
+			{
+				dest = dest.isEmpty() ? group.DestRoot : QDir(group.DestRoot).filePath(dest);
+				rooted = !QDir::isRelativePath(dest);
+			}
+			if (includes.isEmpty())
+				includes = group.Includes;
+			if (policy.isEmpty())
+				policy = group.Policy;
+			excludes << group.Excludes;
+		}
+
+		AutoCopyRule rule;
+		rule.Id = QString::number(rules.id(row));
+		rule.Source = prop.Key;
+		QFileInfo keyInfo(prop.Key);
+		rule.SourceIsDir = keyInfo.isDir();
+		rule.SourcePath = rule.SourceIsDir ? prop.Key : keyInfo.absolutePath();
+		rule.Dest = dest;
+		rule.DestKey = destKey(rule.Dest);
+		rule.Advanced = prop.Advanced;
+		rule.Compress = prop.Compress;
+		rule.Mirror = prop.Mirror;
+		rule.Filter = RuleFilter(includes, excludes);
+		rule.Group = prop.Group;
+		rule.QueueGroup = lanes.value(prop.Group, 0);
+		rule.Policy = SyncPolicy::parse(policy);
+		rule.Transaction = prop.Transaction && !prop.Compress;
+		rule.PublishOrder = prop.PublishOrder;
+		rule.Signature = (QStringList() << rule.Source << rule.DestKey
+			<< RuleFilter::joinPatterns(includes) << RuleFilter::joinPatterns(excludes)
+			<< (rule.Compress ? "acz" : "") << (rule.Mirror ? "mirror" : "")
+			<< (rule.Transaction ? "batch" : "")).join('|');
+		compiled << rule;
 	}
+	return compiled;
+}
+
+QString AutoCopySchedule::destKey(const QString& dest)
+{
+	QString key = QDir::cleanPath(QString(dest).replace("\\", "/"));
+#ifdef Q_OS_WIN
+	key = key.toLower();
+#endif
+	return key;
+}
+
+AutoCopyRuleList AutoCopySchedule::rules()
+{
+	QMutexLocker locker(&m_rulesLock);
+	return m_rules;
+}
+
+bool AutoCopySchedule::matchRule(const AutoCopyRule& rule, const QString& path, QString& relative)
+{
+	if (rule.Source.isEmpty())
+		return false;
+	if (path.compare(rule.Source, kPathCase) == 0)
+	{
+		relative = rule.SourceIsDir ? QString() : QFileInfo(path).fileName();
+		return true;
+	}
+	//ֻƥĿ¼µ·
+	if (!rule.SourceIsDir || !path.startsWith(rule.Source, kPathCase))
+		return false;
+	if (rule.Source.endsWith('/'))
+	{
+		relative = path.mid(rule.Source.size());
+		return true;
+	}
+	if (path.at(rule.Source.size()) == '/')
+	{
+		relative = path.mid(rule.Source.size() + 1);
+		return true;
+	}
+	return false;
+}
+
+bool AutoCopySchedule::acceptPath(const QString& path, bool isDir, int* group)
+{
+	TRACE_SCOPE_ARG("acceptPath", path);
+	bool matched = false;
+	QString relative;
+	for each (const AutoCopyRule& rule in rules())
+	{
+		if (!matchRule(rule, path, relative))
+			continue;
+		if (isDir ? rule.Filter.acceptDir(relative) : rule.Filter.accept(relative))
+		{
+			if (group)
+				*group = rule.QueueGroup;
+			return true;
+		}
+		matched = true;
+	}
+	return !matched;
+}
+
+void AutoCopySchedule::copyExist()
+{
+	const AutoCopyRuleList& rules = this->rules();
+	int nAuto = rules.size();
+	QString src; 
+	//¿ʼ, ϴеĿ¼. ֻڿ̷߳
+	m_dirSnapshots.clear();
+	//ѡļ
+	buildFileOnlyPaths(rules);
 	//Ӽ
 	for (int i = 0; i < nAuto; i++)
 	{
-		const AutoCopyProperty& pro = rules.at(i);
-		src = pro.Key;
+		const AutoCopyRule& pro = rules.at(i);
+		src = pro.Source;
 		
 		addWatcher(src);
 	
@@ -107,6 +452,27 @@ void AutoCopySchedule::copyExist()
 	}
 }
 
+void AutoCopySchedule::buildFileOnlyPaths(const AutoCopyRuleList& rules)
+{
+	m_fileOnlyPaths.clear();
+	m_filesInOnlyPath.clear();
+	for each (const AutoCopyRule& rule in rules)
+	{
+		//file only 
+		if (rule.SourceIsDir)
+			continue;
+		if (!m_fileOnlyPaths.contains(rule.SourcePath))
+			m_fileOnlyPaths.push_back(rule.SourcePath);
+		m_filesInOnlyPath.push_back(rule.Source);
+	}
+	//Ŀ¼ѡʱ
+	for each (const AutoCopyRule& rule in rules)
+	{
+		if (rule.SourceIsDir)
+			m_fileOnlyPaths.removeAll(rule.Source);
+	}
+}
+
 void AutoCopySchedule::addWatcher(const QString& source)
 {	
 	QFileInfo srcInfo(source);
@@ -116,39 +482,114 @@ void AutoCopySchedule::addWatcher(const QString& source)
 		//ļ
 		updateDirFilesWatcher(source);
 		//ǰļ		
-		m_fileSysWatcher->addPath(source);
-		
+		watchPath(source, source);
+		if (m_poller)
+			m_poller->watch(source);
 	}
 	else 
 	{
 		QString srcPath = QFileInfo(source).absolutePath();		
 		//ļ		
-		m_fileSysWatcher->addPath(srcPath);
+		watchPath(srcPath, srcPath);
+		if (m_poller)
+			m_poller->watch(srcPath);
 		//ǰļ		
-		m_fileSysWatcher->addPath(source);
+		watchPath(source, srcPath);
 	}
 }
 
-AutoCopyPropertyList AutoCopySchedule::importFileRules(const QString& filePath)
+bool AutoCopySchedule::watchPath(const QString& path, const QString& dir)
 {
-	AutoCopyPropertyList rules;
-	QDomDocument doc;
-	CTools::openXml(doc, filePath);
-	QDomElement root = doc.firstChildElement("Auto");
-	QDomNodeList ruleNodes = root.childNodes();
-	if (ruleNodes.isEmpty()) return rules;
+	//fanotify ¼ļ, ļؼ
+	if (m_fanotify && (path != dir || m_fanotify->addDirectory(dir)))
+		return true;
+	if (m_fileSysWatcher->addPath(path))
+		return true;
+	//ڼвʧ
+	if (m_fileSysWatcher->files().contains(path) || m_fileSysWatcher->directories().contains(path))
+		return true;
+	//ﵽϵͳ޵, Ŀ¼Ϊʱɨ
+	m_metrics.increment("watch_failures");
+	if (m_poller)
+	{
+		m_poller->addPath(dir);
+	}
+	else
+	{
+		m_copyLog.post(CopyLogEntry::LOG_ERROR,
+			QString("Watch %1 failed, changes will not be noticed").arg(path));
+	}
+	return false;
+}
+
+//Group ڵǶ, е Rule ڸ÷
+static void readRuleNodes(const QDomElement& parent, const QString& group,
+	AutoCopyPropertyList& rules, AutoCopyGroupList* groups)
+{
+	QDomNodeList ruleNodes = parent.childNodes();
 	for (int rule = 0; rule < ruleNodes.size(); rule++)
-	{		
+	{
+		QDomElement node = ruleNodes.at(rule).toElement();
+		if (node.isNull())
+			continue;
+		if (node.tagName() == "Group")
+		{
+			AutoCopyGroup g;
+			g.Name = group.isEmpty() ? node.attribute("name") : group + "/" + node.attribute("name");
+			g.DestRoot = node.attribute("dest");
+			g.Includes = RuleFilter::splitPatterns(node.attribute("include"));
+			g.Excludes = RuleFilter::splitPatterns(node.attribute("exclude"));
+			g.Weight = node.attribute("weight", "1").toInt();
+			g.RateLimit = node.attribute("rate", "0").toLongLong();
+			g.Policy = node.attribute("policy");
+			if (groups)
+				*groups << g;
+			readRuleNodes(node, g.Name, rules, groups);
+			continue;
+		}
 		AutoCopyProperty prop;
-		prop.Key = ruleNodes.at(rule).toElement().attribute("src");
+		prop.Key = node.attribute("src");
 		prop.KeyType = AutoCopyProperty::FILE_PATH;
-		prop.Value = ruleNodes.at(rule).toElement().attribute("dest");
+		prop.Value = node.attribute("dest");
 		prop.ValueType = AutoCopyProperty::PATH;
+		prop.Includes = RuleFilter::splitPatterns(node.attribute("include"));
+		prop.Excludes = RuleFilter::splitPatterns(node.attribute("exclude"));
+		prop.Compress = node.attribute("compress") == "true";
+		prop.Mirror = node.attribute("mirror") == "true";
+		prop.Policy = node.attribute("policy");
+		prop.Transaction = node.attribute("transaction") == "true";
+		prop.PublishOrder = RuleFilter::splitPatterns(node.attribute("order"));
+		prop.Group = group;
 		rules << prop;
 	}
+}
+
+AutoCopyPropertyList AutoCopySchedule::importFileRules(const QString& filePath, AutoCopyGroupList* groups)
+{
+	AutoCopyPropertyList rules;
+	QDomDocument doc;
+	CTools::openXml(doc, filePath);
+	QDomElement root = doc.firstChildElement("Auto");
+	readRuleNodes(root, QString(), rules, groups);
 	return rules;
 }
 
+//ڵ, ȱٵϼһ
+static QDomElement groupElement(QDomDocument& doc, QDomElement& root,
+	QHash<QString, QDomElement>& elements, const QString& name)
+{
+	if (name.isEmpty())
+		return root;
+	if (elements.contains(name))
+		return elements.value(name);
+	QDomElement parent = groupElement(doc, root, elements, name.section('/', 0, -2));
+	QDomElement node = doc.createElement("Group");
+	node.setAttribute("name", name.section('/', -1));
+	parent.appendChild(node);
+	elements.insert(name, node);
+	return node;
+}
+
 AutoCopyPropertyList AutoCopySchedule::importRulesBat(const QString& filePath)
 {
 	AutoCopyPropertyList rules;
@@ -174,17 +615,51 @@ AutoCopyPropertyList AutoCopySchedule::importRulesBat(const QString& filePath)
 	return rules;
 }
 
-void AutoCopySchedule::exportFileRules(const QString& filePath, const AutoCopyPropertyList& rules)
+void AutoCopySchedule::exportFileRules(const QString& filePath, const AutoCopyPropertyList& rules,
+	const AutoCopyGroupList& groups)
 {
 	QDomDocument doc;
 	QDomElement root = doc.createElement("Auto");
+	QHash<QString, QDomElement> groupElements;
+	for each (const AutoCopyGroup& group in groups)
+	{
+		QDomElement node = groupElement(doc, root, groupElements, group.Name);
+		if (group.Name.isEmpty())
+			continue;
+		if (!group.DestRoot.isEmpty())
+			node.setAttribute("dest", group.DestRoot);
+		if (!group.Includes.isEmpty())
+			node.setAttribute("include", RuleFilter::joinPatterns(group.Includes));
+		if (!group.Excludes.isEmpty())
+			node.setAttribute("exclude", RuleFilter::joinPatterns(group.Excludes));
+		if (group.Weight != 1)
+			node.setAttribute("weight", group.Weight);
+		if (group.RateLimit > 0)
+			node.setAttribute("rate", group.RateLimit);
+		if (!group.Policy.isEmpty())
+			node.setAttribute("policy", group.Policy);
+	}
 	int nAuto = rules.size();
 	for (int i = 0; i < nAuto; i++)
 	{
 		QDomElement node = doc.createElement("Rule");	
 		node.setAttribute("src", rules.at(i).Key);
 		node.setAttribute("dest", rules.at(i).Value.toString());
-		root.appendChild(node);
+		if (!rules.at(i).Includes.isEmpty())
+			node.setAttribute("include", RuleFilter::joinPatterns(rules.at(i).Includes));
+		if (!rules.at(i).Excludes.isEmpty())
+			node.setAttribute("exclude", RuleFilter::joinPatterns(rules.at(i).Excludes));
+		if (rules.at(i).Compress)
+			node.setAttribute("compress", "true");
+		if (rules.at(i).Mirror)
+			node.setAttribute("mirror", "true");
+		if (!rules.at(i).Policy.isEmpty())
+			node.setAttribute("policy", rules.at(i).Policy);
+		if (rules.at(i).Transaction)
+			node.setAttribute("transaction", "true");
+		if (!rules.at(i).PublishOrder.isEmpty())
+			node.setAttribute("order", RuleFilter::joinPatterns(rules.at(i).PublishOrder));
+		groupElement(doc, root, groupElements, rules.at(i).Group).appendChild(node);
 	}
 	doc.appendChild(root);
 	CTools::saveXml(doc, filePath);
@@ -208,8 +683,11 @@ void AutoCopySchedule::exportRulesBat(const QString& filePath, const AutoCopyPro
 	}	
 }
 
-void AutoCopySchedule::updateDirFilesWatcher(const QString& root)
+void AutoCopySchedule::updateDirFilesWatcher(const QString& root, QSet<QString>* copied)
 {
+	TRACE_SCOPE_ARG("updateDirFilesWatcher", root);
+	//ͬɾ, ļδ
+	mirrorDirectory(root);
 	//ļɾҪ
 	const QDir dir(root);	
 	//file only
@@ -220,6 +698,9 @@ void AutoCopySchedule::updateDirFilesWatcher(const QString& root)
 	{
 		filePath = info.filePath();
 
+		if (!acceptPath(filePath, false))
+			continue;
+
 		if (m_fileOnlyPaths.contains(root))
 		{
 			if (!m_filesInOnlyPath.contains(filePath))
@@ -236,6 +717,8 @@ void AutoCopySchedule::updateDirFilesWatcher(const QString& root)
 		}	
 
 		copyFile(filePath);
+		if (copied)
+			copied->insert(filePath);
 
 		addWatcher(filePath);
 	}
@@ -243,57 +726,197 @@ void AutoCopySchedule::updateDirFilesWatcher(const QString& root)
 
 void AutoCopySchedule::copyFileTask(const QString& filePath, emTaskType eType/*=COPYFILETASK*/)
 {
-	if (QFile::exists(filePath) || eType == COPYFILEINIT)
+	//ڲѯļ֮ǰ
+	bool isEvent = eType == COPYFILETASK || eType == UPDATEDIRECTORYTASK;
+	int group = 0;
+	if (isEvent && !acceptPath(filePath, eType == UPDATEDIRECTORYTASK, &group))
+		return;
+	if (QFile::exists(filePath) || eType == COPYFILEINIT || eType == UPDATERULESTASK
+		|| eType == ADDRULETASK || eType == RESCANTASK)
 	{
+		//ʱ߳, Ŀ¼, пкɨ
+		if (isEvent && m_tasksQueue.isFull(group))
+		{
+			markOverflow(eType == UPDATEDIRECTORYTASK ? filePath : QFileInfo(filePath).absolutePath());
+			return;
+		}
 		CopyTask *copyTask = new CopyTask(this, filePath, eType);
-		m_tasksQueue.put(copyTask);
+		//ļС
+		qint64 cost = eType == COPYFILETASK ? QFileInfo(filePath).size() : 0;
+		TRACE_SCOPE_ARG("queue.put", filePath);
+		//¼Ѱ, Ӳٵȴ. ʱԻ
+		m_tasksQueue.put(QueuedTask(copyTask, group, cost), 0);
 	}
 }
 
-void AutoCopySchedule::copyFile(const QString& from)
+void AutoCopySchedule::copyFile(const QString& from, qint64 eventUs, const QString& dueRule)
 {
-	const QStringList& dest = checkCopyFile(from);
-	QFile file(from);	
-	for (int i = 0; i < dest.size();i++)
+	TRACE_SCOPE_ARG("copyFile", from);
+	if (eventUs >= 0)
+		m_metrics.recordQueueLatency(clockUs() - eventUs);
+	QStringList ruleIds;
+	QList<bool> compress;
+	AutoCopyRuleList matched;
+	QStringList dest = checkCopyFile(from, &ruleIds, &compress, &matched);
+	//ڵӺ󿽱ֻùĿ, °ͬӺĿŵʱ
+	QDateTime wallClock = QDateTime::currentDateTime();
+	bool isFile = QFile::exists(from) && !QFileInfo(from).isDir();
+	for (int i = dest.size() - 1; i >= 0; i--)
 	{
-		auto aaa = dest.at(i);
-		if (!dest.at(i).isEmpty() && QFile::exists(from) )
+		bool drop = dest.at(i).isEmpty();
+		if (!drop && !dueRule.isEmpty())
+			drop = matched.at(i).Id != dueRule;
+		else if (!drop && isFile)
+			drop = deferCopy(from, matched.at(i), wallClock);
+		if (drop)
 		{
-			if (!file.open((QFile::ReadOnly))) continue;
-			file.close();
+			dest.removeAt(i);
+			ruleIds.removeAt(i);
+			compress.removeAt(i);
+			matched.removeAt(i);
+		}
+	}
+	//Ŀ¼ļ updateDirFilesWatcher 
+	if (dest.isEmpty() || !isFile)
+	{
+		m_retries->cancel(from);
+		return;
+	}
+	{
+		//ļռʱԺ
+		QFile file(from);
+		if (!file.open((QFile::ReadOnly)))
+		{
+			if (!scheduleRetry(from))
+				m_copyLog.post(CopyLogEntry::LOG_ERROR,
+					QString("Copy %1 \n\t skipped : file stays in use").arg(from));
+			return;
+		}
+		file.close();
+	}
 
-			QString strMsg = QString("Copy %1 \n\t to %2").
-				arg(from).arg(dest.at(i));
-			QString error;
-			if (!CTools::copyFileToPath(from, dest.at(i), error))
-			{
-				emit sig_errorMsg(strMsg + QString("  failed : %3").arg(error));
-			}
-			else
-			{
-				emit sig_copyMsg(strMsg);
-			}
+	//Դļֻһ, ͬʱдĿ
+	QStringList errors;
+	QList<CTools::CopyStats> stats;
+	QElapsedTimer timer;
+	timer.start();
+	//ѹ浵Ŀ굥
+	QStringList plainDest;
+	for (int i = 0; i < dest.size(); i++)
+	{
+		errors << QString();
+		stats << CTools::CopyStats();
+		if (compress.at(i))
+			ArchiveCopy::compressFileToPath(from, dest.at(i), errors[i], &stats[i]);
+		else
+			plainDest << dest.at(i);
+	}
+	QStringList plainErrors;
+	QList<CTools::CopyStats> plainStats;
+	if (m_store)
+	{
+		for (int i = 0; i < plainDest.size(); i++)
+		{
+			plainErrors << QString();
+			plainStats << CTools::CopyStats();
+			m_store->materialize(from, plainDest.at(i), plainErrors[i], &plainStats[i]);
 		}
 	}
+	else if (!plainDest.isEmpty())
+	{
+		CTools::copyFileToPaths(from, plainDest, plainErrors, plainStats, true);
+	}
+	for (int i = 0, n = 0; i < dest.size(); i++)
+	{
+		if (compress.at(i))
+			continue;
+		errors[i] = plainErrors.at(n);
+		stats[i] = plainStats.at(n);
+		n++;
+	}
+	qint64 durationUs = timer.nsecsElapsed() / 1000;
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	//Ŀ걻ռû޷ʱ, ڼ䲻
+	bool retryable = false;
+	for each (const CTools::CopyStats& s in stats)
+		retryable |= s.Error == CTools::COPY_FAILED || s.Error == CTools::UNABLE_CREATE;
+	int attempts = m_retries->attempts(from);
+	bool retrying = retryable && scheduleRetry(from);
+	if (!retryable)
+		m_retries->cancel(from);
+	for (int i = 0; i < dest.size(); i++)
+	{
+		bool copied = stats.at(i).Error < 0;
+		QString strMsg = QString("Copy %1 \n\t to %2").
+			arg(from).arg(dest.at(i));
+		m_metrics.recordCopy(ruleIds.value(i), stats.at(i).Bytes, durationUs,
+			!copied ? CopyMetrics::FAILED : (stats.at(i).Skipped ? CopyMetrics::SKIPPED : CopyMetrics::COPIED));
+		if (stats.at(i).Retries > 0)
+		{
+			m_metrics.increment("verify_retries", stats.at(i).Retries);
+			m_copyLog.post(CopyLogEntry::LOG_ERROR, strMsg +
+				QString("  checksum mismatch, copied again %1 time(s)").arg(stats.at(i).Retries));
+		}
+		if (copied)
+		{
+			m_copyLog.post(CopyLogEntry::LOG_COPY, strMsg, dest.at(i));
+		}
+		else if (!retrying)
+		{
+			QString attemptMsg = attempts > 0 ? QString(" after %1 retries").arg(attempts) : QString();
+			m_copyLog.post(CopyLogEntry::LOG_ERROR, strMsg + QString("  failed%1 : %2").arg(attemptMsg).arg(errors.at(i)));
+		}
+		if (m_journal)
+		{
+			CopyJournalRecord rec;
+			rec.Time = now;
+			rec.Rule = ruleIds.value(i);
+			rec.Source = from;
+			rec.Dest = dest.at(i);
+			rec.Bytes = stats.at(i).Bytes;
+			rec.DurationUs = durationUs;
+			rec.Result = !copied ? CopyJournalRecord::FAILED :
+				(stats.at(i).Skipped ? CopyJournalRecord::SKIPPED : CopyJournalRecord::COPIED);
+			rec.ErrorCode = stats.at(i).Error;
+			m_journal->record(rec);
+		}
+	}
+	if (eventUs >= 0)
+		m_metrics.recordEventLatency(clockUs() - eventUs);
 }
 
-QStringList AutoCopySchedule::checkCopyFile(const QString& from)
+CopyMetrics::Snapshot AutoCopySchedule::metricsSnapshot()
 {
-	AutoCopyPropertyList& propList = m_model->properties();
+	CopyMetrics::Snapshot snap = m_metrics.snapshot();
+	snap.QueueDepth = m_tasksQueue.size();
+	return snap;
+}
+
+QStringList AutoCopySchedule::checkCopyFile(const QString& from, QStringList* ruleIds,
+	QList<bool>* compress, AutoCopyRuleList* matched)
+{
+	TRACE_SCOPE_ARG("checkCopyFile", from);
 	QStringList copyToDirs;
-	for each (const AutoCopyProperty& var in propList)
+	QSet<QString> seen;
+	QString relative;
+	for each (const AutoCopyRule& var in rules())
 	{
-		if (QRegExp(var.Key + ".*").exactMatch(from))
-		{
-			QFileInfo keyInfo(var.Key);
-			QString keyPath = keyInfo.isDir() ? var.Key : keyInfo.absolutePath();
-			if (keyPath == from)				
-				copyToDirs.push_back(var.Value.toString());
-			QFileInfo fromInfo(from);
-			QString fromPath = fromInfo.isDir() ? from : fromInfo.absolutePath();
-			
-			copyToDirs.push_back(var.Value.toString());
-		}
+		if (!matchRule(var, from, relative))
+			continue;
+		if (!var.Filter.accept(relative))
+			continue;
+		//ָͬһĿʱֻһ
+		QString key = var.Compress ? var.DestKey + "|acz" : var.DestKey;
+		if (seen.contains(key))
+			continue;
+		seen.insert(key);
+		copyToDirs.push_back(var.Dest);
+		if (ruleIds)
+			ruleIds->push_back(var.Source);
+		if (compress)
+			compress->push_back(var.Compress);
+		if (matched)
+			matched->push_back(var);
 	}
 	return copyToDirs;
 }
@@ -308,9 +931,168 @@ void AutoCopySchedule::resetSchedule()
 		delete m_fileSysWatcher;
 		m_fileSysWatcher = nullptr;
 	}
+	delete m_poller;
+	m_poller = nullptr;
+	delete m_fanotify;
+	m_fanotify = nullptr;
 	m_fileOnlyPaths.clear();
 	m_filesInOnlyPath.clear();
-	m_tasksQueue.clear();
+	for each (const QueuedTask& queued in m_tasksQueue.takeAll())
+		delete queued.Task;
+	QMutexLocker locker(&m_rulesLock);
+	m_rules.clear();
+	m_removedRules.clear();
+}
+
+void AutoCopySchedule::updateRules()
+{
+	if (!m_fileSysWatcher)
+		return;
+	AutoCopyRuleList previous = rules();
+	QVector<QueueShare> shares;
+	AutoCopyRuleList current = compileRules(&shares);
+	//ķݶ޸ĺЧ, Ķб֮
+	m_tasksQueue.setShares(shares);
+	{
+		QMutexLocker locker(&m_rulesLock);
+		m_rules = current;
+	}
+	QSet<QString> previousIds, currentIds;
+	for each (const AutoCopyRule& rule in previous)
+		previousIds.insert(rule.Signature);
+	for each (const AutoCopyRule& rule in current)
+		currentIds.insert(rule.Signature);
+	AutoCopyRuleList added, removed;
+	for each (const AutoCopyRule& rule in current)
+	{
+		if (!previousIds.contains(rule.Signature))
+			added << rule;
+	}
+	for each (const AutoCopyRule& rule in previous)
+	{
+		if (!currentIds.contains(rule.Signature))
+			removed << rule;
+	}
+	if (added.isEmpty() && removed.isEmpty())
+		return;
+
+	//ͬʱ߳޸, ̰߳ȫ, ȥڿ̵߳ applyRules н
+	{
+		QMutexLocker locker(&m_rulesLock);
+		m_removedRules << removed;
+	}
+	//ɾڿʱҲĿ, Ȼ
+	copyFileTask("", UPDATERULESTASK);
+	for each (const AutoCopyRule& rule in added)
+		copyFileTask(rule.Signature, ADDRULETASK);
+	m_copyLog.post(CopyLogEntry::LOG_MESSAGE, QString("Rules updated: %1 added, %2 removed")
+		.arg(added.size()).arg(removed.size()));
+}
+
+void AutoCopySchedule::applyRules()
+{
+	const AutoCopyRuleList& current = this->rules();
+	buildFileOnlyPaths(current);
+	//پĿ¼ȥ
+	QSet<QString> mirrored;
+	for each (const AutoCopyRule& rule in current)
+	{
+		if (rule.Mirror && rule.SourceIsDir)
+			mirrored.insert(rule.Source);
+	}
+	for (QHash<QString, DirSnapshot>::iterator it = m_dirSnapshots.begin(); it != m_dirSnapshots.end();)
+	{
+		if (mirrored.contains(it.key()))
+			++it;
+		else
+			it = m_dirSnapshots.erase(it);
+	}
+
+	AutoCopyRuleList removed;
+	{
+		QMutexLocker locker(&m_rulesLock);
+		removed.swap(m_removedRules);
+	}
+	if (removed.isEmpty() || !m_fileSysWatcher)
+		return;
+	//ɾĹ: ֻȥҪļ
+	QSet<QString> removedDirs, neededDirs, ruleDirs, ruleFiles;
+	for each (const AutoCopyRule& rule in removed)
+		removedDirs.insert(destKey(rule.SourcePath));
+	for each (const AutoCopyRule& rule in current)
+	{
+		neededDirs.insert(destKey(rule.SourcePath));
+		if (rule.SourceIsDir)
+			ruleDirs.insert(destKey(rule.Source));
+		else
+			ruleFiles.insert(destKey(rule.Source));
+	}
+	QStringList unwatch;
+	for each (const QString& dir in m_fileSysWatcher->directories())
+	{
+		QString key = destKey(dir);
+		if (removedDirs.contains(key) && !neededDirs.contains(key))
+			unwatch << dir;
+	}
+	for each (const QString& file in m_fileSysWatcher->files())
+	{
+		QString parent = destKey(QFileInfo(file).absolutePath());
+		if (removedDirs.contains(parent) && !ruleDirs.contains(parent)
+			&& !ruleFiles.contains(destKey(file)))
+			unwatch << file;
+	}
+	if (!unwatch.isEmpty())
+		m_fileSysWatcher->removePaths(unwatch);
+	if (m_poller && !unwatch.isEmpty())
+		m_poller->removePaths(unwatch);
+	if (m_fanotify)
+	{
+		QStringList fanotifyDirs;
+		for each (const QString& dir in m_fanotify->directories())
+		{
+			QString key = destKey(dir);
+			if (removedDirs.contains(key) && !neededDirs.contains(key))
+				fanotifyDirs << dir;
+		}
+		m_fanotify->removeDirectories(fanotifyDirs);
+	}
+}
+
+void AutoCopySchedule::addRule(const QString& signature)
+{
+	//ͬһԴǸ߼, 
+	AutoCopyRule rule;
+	bool found = false;
+	for each (const AutoCopyRule& var in rules())
+	{
+		if (var.Signature == signature)
+		{
+			rule = var;
+			found = true;
+			break;
+		}
+	}
+	//Ӻֱɾ
+	if (!found)
+		return;
+	const QString source = rule.Source;
+	addWatcher(source);
+	//ѿ
+	if (rule.Advanced)
+		return;
+	if (!rule.SourceIsDir)
+	{
+		copyFile(source);
+		return;
+	}
+	//Ѽӵļᱻ updateDirFilesWatcher ٴο, ĿҪ, µ
+	QFileInfoList entries = QDir(source).entryInfoList(QDir::NoDotAndDotDot | QDir::Files);
+	QString relative;
+	for each (const QFileInfo& info in entries)
+	{
+		if (matchRule(rule, info.filePath(), relative) && rule.Filter.accept(relative))
+			copyFile(info.filePath());
+	}
 }
 
 QStringList AutoCopySchedule::currentWatchPath()
@@ -318,30 +1100,480 @@ QStringList AutoCopySchedule::currentWatchPath()
 	QStringList paths;
 	paths << m_fileSysWatcher->files();
 	paths << m_fileSysWatcher->directories();
+	if (m_fanotify)
+		paths << m_fanotify->directories();
 	return paths;
 }
 
 void AutoCopySchedule::run()
 {
-	while (true)
+	//take ڶΪʱ, ٿת; дԵļʱʱֵĿ̶
+	while (!isInterruptionRequested())
 	{
-		if (!m_tasksQueue.isEmpty())
+		unsigned long waitMs = m_retries->isEmpty() ? ULONG_MAX : (unsigned long)m_retries->tickMs();
+		//еȡ, ӺĿҲҪʱȡ, ̶
+		if (!m_tasksQueue.isEmpty() || !m_deferred->isEmpty())
+			waitMs = qMin(waitMs, (unsigned long)m_retries->tickMs());
+		QRunnable *task = m_tasksQueue.take(waitMs).Task;
+		if (task)
 		{
-			QRunnable *task = m_tasksQueue.take();
 			task->run();
+			delete task;
 		}
+		if (isInterruptionRequested())
+			break;
+		retryDue();
+		deferredDue();
+		//Ŀ¼ڶպɨ
+		if (m_tasksQueue.isEmpty())
+			rescanOverflow();
+	}
+}
+
+void AutoCopySchedule::rescanOverflow()
+{
+	QStringList dirs;
+	{
+		QMutexLocker locker(&m_overflowLock);
+		dirs = m_overflowDirs.toList();
+		m_overflowDirs.clear();
 	}
+	if (!dirs.isEmpty())
+		rescan(dirs);
+}
+
+void AutoCopySchedule::markOverflow(const QString& dir)
+{
+	QMutexLocker locker(&m_overflowLock);
+	if (m_overflowDirs.contains(dir))
+		return;
+	m_overflowDirs.insert(dir);
+	m_metrics.increment("overflows");
+}
+
+void AutoCopySchedule::rescan(const QStringList& dirs)
+{
+	TRACE_SCOPE("rescan");
+	QVector<RescanJob> jobs(dirs.size());
+	{
+		QThreadPool pool;
+		pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+		for (int i = 0; i < dirs.size(); i++)
+		{
+			jobs[i].Dir = dirs.at(i);
+			pool.start(new RescanTask(this, &jobs[i]));
+		}
+		pool.waitForDone();
+	}
+	int stale = 0;
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		//ļ updateDirFilesWatcher , ѼӵĹļ�
+		QSet<QString> copied;
+		updateDirFilesWatcher(jobs.at(i).Dir, &copied);
+		for each (const QString& path in jobs.at(i).Stale)
+		{
+			if (!copied.contains(path))
+				copyFile(path);
+		}
+		stale += jobs.at(i).Stale.size();
+	}
+	m_metrics.increment("rescan_files", stale);
+	m_copyLog.post(CopyLogEntry::LOG_MESSAGE,
+		QString("Rescanned %1 directories after dropped events, %2 files out of date")
+		.arg(dirs.size()).arg(stale));
+}
+
+bool AutoCopySchedule::scheduleRetry(const QString& from)
+{
+	if (m_retries->schedule(from, m_clock.elapsed()) < 0)
+	{
+		m_metrics.increment("retries_exhausted");
+		return false;
+	}
+	m_metrics.increment("retries_scheduled");
+	return true;
+}
+
+bool AutoCopySchedule::deferCopy(const QString& from, const AutoCopyRule& rule,
+	const QDateTime& now)
+{
+	const SyncPolicy& policy = rule.Policy;
+	if (!rule.Transaction && policy.isImmediate())
+		return false;
+	//Ĺûвʱ޸ֹͣһʱ
+	qint64 delay = policy.isImmediate() ? m_batchQuietMs : policy.delayMs(now);
+	if (delay <= 0 && !rule.Transaction)
+		return false;
+	//ʱ䴰ж޸ֻһ, ÿ޸¼ʱ
+	//ĹһĿ, ·Ϊ
+	QString key = rule.Id + "\n" + (rule.Transaction ? QString() : from);
+	if (rule.Transaction)
+		m_batches[rule.Id].insert(from);
+	bool pending = m_deferred->contains(key);
+	m_metrics.increment(pending ? "deferred_merged" : "deferred");
+	if (pending && !policy.isImmediate() && !policy.restartsOnChange())
+		return true;
+	qint64 nowMs = m_clock.elapsed();
+	m_deferred->scheduleAt(key, nowMs + delay, nowMs);
+	return true;
+}
+
+void AutoCopySchedule::deferredDue()
+{
+	if (m_deferred->isEmpty())
+		return;
+	QStringList due;
+	m_deferred->advance(m_clock.elapsed(), due);
+	for each (const QString& key in due)
+	{
+		int sep = key.indexOf('\n');
+		if (sep == key.size() - 1)
+		{
+			commitBatch(key.left(sep));
+			continue;
+		}
+		m_metrics.increment("deferred_copies");
+		copyFile(key.mid(sep + 1), -1, key.left(sep));
+	}
+}
+
+//˳еһƥλ, δгļΪ 0 ȷ
+static int publishRank(const AutoCopyRule& rule, const QString& name)
+{
+	for (int i = 0; i < rule.PublishOrder.size(); ++i)
+	{
+		if (QRegExp(rule.PublishOrder.at(i), Qt::CaseInsensitive, QRegExp::Wildcard).exactMatch(name))
+			return i + 1;
+	}
+	return 0;
+}
+
+static const char* kBatchManifest = "autocopy.manifest";
+static const char* kBatchStaging = ".autocopy-staging-";
+static const int kBatchMaxAttempts = 8;
+
+void AutoCopySchedule::commitBatch(const QString& ruleId)
+{
+	TRACE_SCOPE_ARG("commitBatch", ruleId);
+	QSet<QString> pending = m_batches.take(ruleId);
+	AutoCopyRule rule;
+	bool found = false;
+	for each (const AutoCopyRule& var in rules())
+	{
+		if (var.Id == ruleId && var.Transaction)
+		{
+			rule = var;
+			found = true;
+			break;
+		}
+	}
+	if (!found)
+	{
+		m_batchAttempts.remove(ruleId);
+		return;
+	}
+	//ڼɾļٷ
+	QList<QPair<int, QString> > ordered;
+	for each (const QString& from in pending)
+	{
+		QFileInfo info(from);
+		if (info.isFile())
+			ordered << qMakePair(publishRank(rule, info.fileName()), from);
+	}
+	if (ordered.isEmpty())
+		return;
+	qSort(ordered);
+
+	QString destDir = QString(rule.Dest).replace("\\", "/");
+	QString batchId = QDateTime::currentDateTime().toString("yyyyMMddHHmmsszzz");
+	//ݴĿ¼ĿĿ¼, ֻ
+	QString staging = destDir + "/" + kBatchStaging + batchId;
+	QElapsedTimer timer;
+	timer.start();
+	QStringList names;
+	QString error;
+	bool staged = QDir().mkpath(staging);
+	for (int i = 0; staged && i < ordered.size(); ++i)
+	{
+		names << QFileInfo(ordered.at(i).second).fileName();
+		staged = CTools::copyFileToPath(ordered.at(i).second, staging, error);
+	}
+	//ļʧʱԺ, Ŀѷݲ
+	if (!staged)
+	{
+		QDir(staging).removeRecursively();
+		if (!retryBatch(ruleId, pending))
+		{
+			m_copyLog.post(CopyLogEntry::LOG_ERROR, QString("Batch %1 \n\t to %2 failed after %3 attempts : %4")
+				.arg(rule.Source).arg(destDir).arg(kBatchMaxAttempts).arg(error));
+		}
+		return;
+	}
+
+	//ڼû嵥, ߲ѷһĿ¼һ
+	QString manifest = destDir + "/" + kBatchManifest;
+	bool published = !QFile::exists(manifest) || QFile::remove(manifest);
+	if (!published)
+		error = manifest;
+	int publishedCount = 0;
+	QList<qint64> sizes;
+	for (int i = 0; published && i < names.size(); ++i)
+	{
+		QString to = destDir + "/" + names.at(i);
+		if (!CTools::replaceFile(staging + "/" + names.at(i), to))
+		{
+			published = false;
+			error = to;
+			break;
+		}
+		sizes << QFileInfo(to).size();
+		publishedCount++;
+	}
+	//嵥д, дʱļٸ, 嵥
+	if (published)
+	{
+		QFile file(manifest + ".part");
+		published = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+		if (published)
+		{
+			QTextStream out(&file);
+			out.setCodec("UTF-8");
+			out << "batch\t" << batchId << "\n";
+			out << "rule\t" << rule.Source << "\n";
+			for (int i = 0; i < names.size(); ++i)
+				out << sizes.at(i) << "\t" << names.at(i) << "\n";
+			out << "complete\t" << names.size() << "\n";
+			out.flush();
+			file.close();
+			published = file.error() == QFileDevice::NoError && CTools::replaceFile(file.fileName(), manifest);
+		}
+		if (!published)
+			error = manifest;
+	}
+	QDir(staging).removeRecursively();
+
+	//ʧʱʧ, δļԺ. û嵥ʱѷļҲ·
+	if (!published)
+	{
+		QSet<QString> unpublished;
+		int first = publishedCount < names.size() ? publishedCount : 0;
+		for (int i = first; i < ordered.size(); ++i)
+			unpublished.insert(ordered.at(i).second);
+		bool retrying = retryBatch(ruleId, unpublished);
+		m_copyLog.post(CopyLogEntry::LOG_ERROR, QString("Batch %1 \n\t publish failed at %2, %3 of %4 files published%5")
+			.arg(batchId).arg(error).arg(publishedCount).arg(names.size())
+			.arg(retrying ? QString() : QString(", giving up after %1 attempts").arg(kBatchMaxAttempts)));
+		return;
+	}
+	m_batchAttempts.remove(ruleId);
+
+	qint64 durationUs = timer.nsecsElapsed() / 1000;
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	for (int i = 0; i < sizes.size(); ++i)
+	{
+		QString from = ordered.at(i).second;
+		QString to = destDir + "/" + names.at(i);
+		m_metrics.recordCopy(rule.Source, sizes.at(i), durationUs, CopyMetrics::COPIED);
+		m_copyLog.post(CopyLogEntry::LOG_COPY, QString("Copy %1 \n\t to %2").arg(from).arg(to), to);
+		if (m_journal)
+		{
+			CopyJournalRecord rec;
+			rec.Time = now;
+			rec.Rule = rule.Source;
+			rec.Source = from;
+			rec.Dest = to;
+			rec.Bytes = sizes.at(i);
+			rec.DurationUs = durationUs;
+			rec.Result = CopyJournalRecord::COPIED;
+			m_journal->record(rec);
+		}
+	}
+	m_metrics.increment("batches");
+	m_copyLog.post(CopyLogEntry::LOG_MESSAGE, QString("Batch %1: %2 files published to %3")
+		.arg(batchId).arg(names.size()).arg(destDir));
+}
+
+bool AutoCopySchedule::retryBatch(const QString& ruleId, const QSet<QString>& sources)
+{
+	int attempt = m_batchAttempts.value(ruleId) + 1;
+	if (attempt > kBatchMaxAttempts)
+	{
+		m_batchAttempts.remove(ruleId);
+		m_metrics.increment("batches_failed");
+		return false;
+	}
+	m_batchAttempts.insert(ruleId, attempt);
+	m_batches[ruleId].unite(sources);
+	qint64 nowMs = m_clock.elapsed();
+	m_deferred->scheduleAt(ruleId + "\n", nowMs + (m_batchQuietMs << qMin(attempt, 6)), nowMs);
+	m_metrics.increment("batch_retries");
+	return true;
+}
+
+void AutoCopySchedule::retryDue()
+{
+	if (m_retries->isEmpty())
+		return;
+	QStringList due;
+	m_retries->advance(m_clock.elapsed(), due);
+	for each (const QString& path in due)
+	{
+		m_metrics.increment("retries");
+		copyFile(path);
+	}
+}
+
+void AutoCopySchedule::mirrorDirectory(const QString& root)
+{
+	//ֻڹĿ¼µļ
+	AutoCopyRuleList mirrors;
+	QString rootKey = destKey(root);
+	for each (const AutoCopyRule& rule in rules())
+	{
+		if (rule.Mirror && rule.SourceIsDir && destKey(rule.Source) == rootKey)
+			mirrors << rule;
+	}
+	if (mirrors.isEmpty())
+		return;
+	TRACE_SCOPE_ARG("mirrorDirectory", root);
+
+	//һֻ¼, ֮ϴαȽ
+	bool first = !m_dirSnapshots.contains(root);
+	const DirSnapshot previous = m_dirSnapshots.value(root);
+	DirSnapshot current;
+	QHash<QByteArray, QString> added;	//ļ id -> ļ
+	QFileInfoList entries = QDir(root).entryInfoList(
+		QDir::NoDotAndDotDot | QDir::Files | QDir::Hidden | QDir::System);
+	for each (const QFileInfo& info in entries)
+	{
+		MirrorEntry entry;
+		entry.Size = info.size();
+		entry.ModifiedMs = info.lastModified().toMSecsSinceEpoch();
+		DirSnapshot::const_iterator it = previous.find(info.fileName());
+		//Сʱδʱϴε id, ֻļͱ滻ļ򿪾
+		if (it != previous.end() && it.value().Size == entry.Size
+			&& it.value().ModifiedMs == entry.ModifiedMs)
+			entry.Id = it.value().Id;
+		else
+			entry.Id = CTools::fileId(info.filePath());
+		if (!first && it == previous.end() && !entry.Id.isEmpty())
+			added.insert(entry.Id, info.fileName());
+		current.insert(info.fileName(), entry);
+	}
+	m_dirSnapshots.insert(root, current);
+	if (first)
+		return;
+
+	for (DirSnapshot::const_iterator it = previous.begin(); it != previous.end(); ++it)
+	{
+		if (current.contains(it.key()))
+			continue;
+		//ͬһļ id, С޸ʱ䶼
+		QString newName;
+		if (!it.value().Id.isEmpty())
+		{
+			QHash<QByteArray, QString>::iterator found = added.find(it.value().Id);
+			if (found != added.end())
+			{
+				const MirrorEntry& entry = current.value(found.value());
+				if (entry.Size == it.value().Size && entry.ModifiedMs == it.value().ModifiedMs)
+				{
+					newName = found.value();
+					added.erase(found);
+				}
+			}
+		}
+		QString oldPath = root + "/" + it.key();
+		if (m_fileSysWatcher)
+			m_fileSysWatcher->removePath(oldPath);
+		for each (const AutoCopyRule& rule in mirrors)
+		{
+			if (!rule.Filter.accept(it.key()))
+				continue;
+			//Ŀʧʱɾļ, ļ
+			if (!newName.isEmpty() && rule.Filter.accept(newName)
+				&& mirrorRename(rule, it.key(), newName))
+				continue;
+			mirrorRemove(rule, it.key());
+		}
+	}
+}
+
+bool AutoCopySchedule::mirrorRemove(const AutoCopyRule& rule, const QString& name)
+{
+	QString suffix = rule.Compress ? ArchiveCopy::archiveSuffix() : QString();
+	QString destFile = QString(rule.Dest).replace("\\", "/") + "/" + name + suffix;
+	if (!QFile::exists(destFile))
+		return true;
+	QString strMsg = QString("Delete %1").arg(destFile);
+	if (!QFile::remove(destFile))
+	{
+		m_copyLog.post(CopyLogEntry::LOG_ERROR, strMsg + "  failed");
+		return false;
+	}
+	m_metrics.increment("mirror_deletes");
+	m_copyLog.post(CopyLogEntry::LOG_MESSAGE, strMsg);
+	journalMirror(rule, QDir(rule.Source).filePath(name), destFile, CopyJournalRecord::DELETED);
+	return true;
+}
+
+bool AutoCopySchedule::mirrorRename(const AutoCopyRule& rule, const QString& oldName,
+	const QString& newName)
+{
+	QString suffix = rule.Compress ? ArchiveCopy::archiveSuffix() : QString();
+	QString dir = QString(rule.Dest).replace("\\", "/") + "/";
+	QString from = dir + oldName + suffix;
+	QString to = dir + newName + suffix;
+	if (!QFile::exists(from))
+		return false;
+	if (QFile::exists(to) && !QFile::remove(to))
+		return false;
+	if (!QFile::rename(from, to))
+		return false;
+	m_metrics.increment("mirror_renames");
+	m_copyLog.post(CopyLogEntry::LOG_MESSAGE, QString("Rename %1 \n\t to %2").arg(from).arg(to));
+	journalMirror(rule, QDir(rule.Source).filePath(newName), to, CopyJournalRecord::RENAMED);
+	return true;
+}
+
+void AutoCopySchedule::journalMirror(const AutoCopyRule& rule, const QString& source,
+	const QString& dest, int result)
+{
+	if (!m_journal)
+		return;
+	CopyJournalRecord rec;
+	rec.Time = QDateTime::currentMSecsSinceEpoch();
+	rec.Rule = rule.Source;
+	rec.Source = source;
+	rec.Dest = dest;
+	rec.Result = result;
+	m_journal->record(rec);
 }
 
 void AutoCopySchedule::directoryUpdated(const QString &path)
 {
+	TRACE_SCOPE_ARG("directoryUpdated", path);
 	qDebug() << "dir" << path;
+	m_metrics.increment("dir_events");
+	m_model->invalidatePath(path);
 	copyFileTask(path, UPDATEDIRECTORYTASK);
 }
 
+void AutoCopySchedule::fanotifyOverflowed()
+{
+	//ں˶, ʧ¼޷ȷĸĿ¼, ȫɨ
+	for each (const QString& dir in m_fanotify->directories())
+		markOverflow(dir);
+	copyFileTask("", RESCANTASK);
+}
+
 void AutoCopySchedule::fileUpdated(const QString& file)
 {
+	TRACE_SCOPE_ARG("fileUpdated", file);
 	qDebug() << "file" << file;
+	m_metrics.increment("file_events");
+	m_model->invalidatePath(file);
 	copyFileTask(file, COPYFILETASK);
 }
 
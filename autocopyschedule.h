@@ -5,53 +5,179 @@
 #include <QStringList>
 #include <QHash>
 #include <QSet>
-#include "BlockingQueue.h"
+#include <QMutex>
+#include <QElapsedTimer>
+#include "groupqueue.h"
 #include "autocopy.h"
+#include "rulefilter.h"
+#include "copylog.h"
+#include "copymetrics.h"
+#include "syncpolicy.h"
 
+// rule as used by the copy thread, compiled once when the schedule starts
+struct AutoCopyRule
+{
+	QString Id;			// RuleStore::id of the rule, unique even for rules on the same Source
+	QString Source;		// rule key
+	QString SourcePath;	// directory watched for the rule
+	bool SourceIsDir;
+	QString Dest;
+	QString DestKey;	// Dest normalized, to find duplicate destinations
+	bool Advanced;
+	bool Compress;		// Dest holds compressed archives
+	bool Mirror;		// deletes and renames in Source are repeated in Dest
+	RuleFilter Filter;
+	QString Signature;	// everything the copy depends on, to diff rule edits
+	QString Group;
+	int QueueGroup;		// lane of the group in the copy queue
+	SyncPolicy Policy;
+	bool Transaction;	// changes are staged and published as one batch
+	QStringList PublishOrder;
+};
+typedef QList<AutoCopyRule> AutoCopyRuleList;
 
 class QFileSystemWatcher;
 class AutoRuleModel;
 class QRunnable;
+class CopyJournal;
+class ContentStore;
+class RetryWheel;
+class PollScanner;
+class FanotifyWatcher;
 class AutoCopySchedule : public QThread
 {
 	Q_OBJECT
 public:
-	enum emTaskType { COPYFILEINIT, COPYFILETASK, UPDATEDIRECTORYTASK };
+	enum emTaskType { COPYFILEINIT, COPYFILETASK, UPDATEDIRECTORYTASK, UPDATERULESTASK,
+		ADDRULETASK, RESCANTASK };
 	AutoCopySchedule( AutoRuleModel* model);
+	// stops the copy thread after its current task, then flushes the journal
+	// and saves the content store
+	~AutoCopySchedule();
+	// reads the settings of later schedules from this ini file instead of the
+	// user's settings, used by the benchmark. empty restores the default
+	static void setSettingsFile(const QString& iniPath);
 public:
 	void createWatcher();
 	void copyExist();
 	void addWatcher(const QString& source);
 	//xml
-	AutoCopyPropertyList importFileRules(const QString& filePath);
+	AutoCopyPropertyList importFileRules(const QString& filePath, AutoCopyGroupList* groups = nullptr);
 	AutoCopyPropertyList importRulesBat(const QString& filePath);
 	//xml
-	void exportFileRules(const QString& filePath, const AutoCopyPropertyList& rules);
+	void exportFileRules(const QString& filePath, const AutoCopyPropertyList& rules,
+		const AutoCopyGroupList& groups = AutoCopyGroupList());
 	void exportRulesBat(const QString& filePath, const AutoCopyPropertyList& rules);
 	//
 	void copyFileTask(const QString& filePath, emTaskType eType);
-	void copyFile(const QString& from);
-	void updateDirFilesWatcher(const QString& root);
-	QStringList checkCopyFile(const QString& from);
+	// eventUs: clockUs() of the change event, -1 if unknown.
+	// destinations whose sync policy defers the copy are put on the deferred
+	// wheel; dueRule (AutoCopyRule::Id) copies only to the rule whose deferred
+	// copy is due
+	void copyFile(const QString& from, qint64 eventUs = -1, const QString& dueRule = QString());
+	// copied receives the files copied here, new to the watcher
+	void updateDirFilesWatcher(const QString& root, QSet<QString>* copied = nullptr);
+	// ruleIds receives the source key of the rule behind every destination,
+	// compress whether the destination takes compressed archives
+	// matched the rule itself
+	QStringList checkCopyFile(const QString& from, QStringList* ruleIds = nullptr,
+		QList<bool>* compress = nullptr, AutoCopyRuleList* matched = nullptr);
+	// group receives the queue lane of the accepting rule
+	bool acceptPath(const QString& path, bool isDir, int* group = nullptr);
 	//
 	void resetSchedule();
+	//޸ĺֻ±仯Ĺ, δʼʱ
+	void updateRules();
+	//߳: ȥɾĹҪļ
+	void applyRules();
+	//߳: Ӳ¹, signature Ϊ AutoCopyRule::Signature
+	void addRule(const QString& signature);
 	QStringList currentWatchPath();
+	//Ϣ, ɽ涨ʱȡ
+	CopyLog* copyLog() { return &m_copyLog; }
+	//ͳ
+	CopyMetrics* metrics() { return &m_metrics; }
+	CopyMetrics::Snapshot metricsSnapshot();
+	qint64 clockUs() const { return m_clock.nsecsElapsed() / 1000; }
 
 signals:
-	void sig_copyMsg(const QString& msg);
-	void sig_errorMsg(const QString& error);
 	void sig_tipMessage(const QString& error);
 protected:
 	void run();
 private slots:
 	void fileUpdated(const QString& file);
 	void directoryUpdated(const QString &path);
+	void fanotifyOverflowed();
+private:
+	void buildRules();
+	// shares receives the queue lanes of the rule groups
+	AutoCopyRuleList compileRules(QVector<QueueShare>* shares = nullptr);
+	AutoCopyRuleList rules();
+	void buildFileOnlyPaths(const AutoCopyRuleList& rules);
+	static bool matchRule(const AutoCopyRule& rule, const QString& path, QString& relative);
+	static QString destKey(const QString& dest);
+	// false once the attempts of the path are used up
+	bool scheduleRetry(const QString& from);
+	void retryDue();
+	// true if the policy or the batch of the rule holds the copy of from back
+	bool deferCopy(const QString& from, const AutoCopyRule& rule, const QDateTime& now);
+	void deferredDue();
+	// copies the collected files of a transactional rule to a staging
+	// directory, renames them into place in publish order and writes the
+	// manifest last. ruleId is AutoCopyRule::Id, rules on the same source
+	// keep separate batches
+	void commitBatch(const QString& ruleId);
+	// puts sources back into the batch of ruleId and commits it again later,
+	// false once the attempts are used up
+	bool retryBatch(const QString& ruleId, const QSet<QString>& sources);
+	// events dropped while the queue was full, the directory is rescanned
+	// once the queue has drained
+	void markOverflow(const QString& dir);
+	// lists dirs in parallel and copies the files whose destinations are stale
+	void rescan(const QStringList& dirs);
+	void rescanOverflow();
+	// addPath, a path the watcher refuses is polled instead
+	bool watchPath(const QString& path, const QString& dir);
+	// repeats deletes and renames of the files directly in root for the
+	// mirror rules of root, renames are paired by file id
+	void mirrorDirectory(const QString& root);
+	bool mirrorRemove(const AutoCopyRule& rule, const QString& name);
+	bool mirrorRename(const AutoCopyRule& rule, const QString& oldName, const QString& newName);
+	void journalMirror(const AutoCopyRule& rule, const QString& source, const QString& dest,
+		int result);
 private:
 	QFileSystemWatcher* m_fileSysWatcher;
 	AutoRuleModel* m_model;
-	BlockingQueue<QRunnable*> m_tasksQueue;
+	GroupQueue m_tasksQueue;
 	QStringList m_fileOnlyPaths;
 	QStringList m_filesInOnlyPath;
+	QMutex m_rulesLock;
+	AutoCopyRuleList m_rules;
+	AutoCopyRuleList m_removedRules;	//updateRules ɾ,  applyRules ȥ, m_rulesLock
+	CopyLog m_copyLog;
+	CopyJournal* m_journal;
+	ContentStore* m_store;
+	RetryWheel* m_retries;	// copy thread only
+	RetryWheel* m_deferred;	// copies held back by sync policies, copy thread only
+	// sources collected for the batch of a rule, copy thread only
+	QHash<QString, QSet<QString> > m_batches;
+	QHash<QString, int> m_batchAttempts;
+	qint64 m_batchQuietMs;
+	PollScanner* m_poller;	// directories without change notifications
+	FanotifyWatcher* m_fanotify;	// mount-wide notifications, Linux only
+	QMutex m_overflowLock;
+	QSet<QString> m_overflowDirs;
+	// files of a mirrored directory as last seen, name -> identity
+	struct MirrorEntry
+	{
+		QByteArray Id;
+		qint64 Size;
+		qint64 ModifiedMs;
+	};
+	typedef QHash<QString, MirrorEntry> DirSnapshot;
+	QHash<QString, DirSnapshot> m_dirSnapshots;	// copy thread only
+	CopyMetrics m_metrics;
+	QElapsedTimer m_clock;
 };
 
 #endif // AUTOCOPYSCHEDULE_H
@@ -12,50 +12,40 @@
 #include <QStyle>
 #include <QMenu>
 #include <QFileInfo>
+#include <QInputDialog>
+#include <QColor>
 
 #include "editwidgets.h"
+#include "pathchecker.h"
+#include "rulefilter.h"
+#include "syncpolicy.h"
 
-// filter for searches
+// filter for searches, the matches come from the search index of the model
 class RuleSearchFilter : public QSortFilterProxyModel
 {
 public:
-  RuleSearchFilter(QObject* o)
+  RuleSearchFilter(QObject* o, AutoRuleModel* rules)
     : QSortFilterProxyModel(o)
+    , Rules(rules)
   {
   }
 
-protected:
-  bool filterAcceptsRow(int row, const QModelIndex& p) const override
+  void setQuery(const QString& s)
   {
-    QStringList strs;
-    const QAbstractItemModel* m = this->sourceModel();
-    QModelIndex idx = m->index(row, 0, p);
-
-    // if there are no children, get strings for column 0 and 1
-    if (!m->hasChildren(idx)) {
-      strs.append(m->data(idx).toString());
-      idx = m->index(row, 1, p);
-      strs.append(m->data(idx).toString());
-    } else {
-      // get strings for children entries to compare with
-      // instead of comparing with the parent
-      int num = m->rowCount(idx);
-      for (int i = 0; i < num; i++) {
-        QModelIndex tmpidx = m->index(i, 0, idx);
-        strs.append(m->data(tmpidx).toString());
-        tmpidx = m->index(i, 1, idx);
-        strs.append(m->data(tmpidx).toString());
-      }
-    }
+    this->Rules->setSearchQuery(s);
+    this->invalidateFilter();
+  }
 
-    // check all strings for a match
-    foreach (QString const& str, strs) {
-      if (str.contains(this->filterRegExp())) {
-        return true;
-      }
-    }
+protected:
+  AutoRuleModel* Rules;
 
-    return false;
+  bool filterAcceptsRow(int row, const QModelIndex& p) const override
+  {
+    // rows arrive through the advanced filter, the index knows model rows
+    const QAbstractProxyModel* m =
+      static_cast<const QAbstractProxyModel*>(this->sourceModel());
+    QModelIndex src = m->mapToSource(m->index(row, 0, p));
+    return !src.isValid() || this->Rules->searchMatches(src.row());
   }
 };
 
@@ -110,9 +100,8 @@ AutoRuleView::AutoRuleView(QWidget* p)
   this->AdvancedFilter = new RuleAdvancedFilter(this);
   this->AdvancedFilter->setSourceModel(this->CacheModel);
   this->AdvancedFilter->setDynamicSortFilter(true);
-  this->SearchFilter = new RuleSearchFilter(this);
+  this->SearchFilter = new RuleSearchFilter(this, this->CacheModel);
   this->SearchFilter->setSourceModel(this->AdvancedFilter);
-  this->SearchFilter->setFilterCaseSensitivity(Qt::CaseInsensitive);
   this->SearchFilter->setDynamicSortFilter(true);
   this->setModel(this->SearchFilter);
 
@@ -138,7 +127,56 @@ AutoRuleView::AutoRuleView(QWidget* p)
 	  CacheModel->insertProperty(AutoCopyProperty::FILE_PATH, AutoCopyProperty::PATH, "", "",
 		  "", false);
   });
+  m_pMenu->addAction(QString::fromLocal8Bit("..."), this, [=]{
+	  editFilters(currentIndex());
+  });
+  QAction* compressAction = m_pMenu->addAction(QString::fromLocal8Bit("ѹ浵"));
+  compressAction->setCheckable(true);
+  connect(compressAction, &QAction::triggered, [=](bool checked){
+    QModelIndex src = sourceIndex(currentIndex());
+    if (!src.isValid()) {
+      return;
+    }
+    CacheModel->setPropertyCompress(src, checked);
+    emit sig_updateSchedule();
+  });
+  m_pMenu->addAction(QString::fromLocal8Bit("..."), this, [=]{
+    editGroup(currentIndex());
+  });
+  m_pMenu->addAction(QString::fromLocal8Bit("ͬ..."), this, [=]{
+    editPolicy(currentIndex());
+  });
+  QAction* mirrorAction = m_pMenu->addAction(QString::fromLocal8Bit("ͬɾ/"));
+  mirrorAction->setCheckable(true);
+  connect(mirrorAction, &QAction::triggered, [=](bool checked){
+    QModelIndex src = sourceIndex(currentIndex());
+    if (!src.isValid()) {
+      return;
+    }
+    CacheModel->setPropertyMirror(src, checked);
+    emit sig_updateSchedule();
+  });
+  QAction* transactionAction = m_pMenu->addAction(QString::fromLocal8Bit(""));
+  transactionAction->setCheckable(true);
+  connect(transactionAction, &QAction::triggered, [=](bool checked){
+    QModelIndex src = sourceIndex(currentIndex());
+    if (!src.isValid()) {
+      return;
+    }
+    CacheModel->setPropertyTransaction(src, checked);
+    emit sig_updateSchedule();
+  });
   connect(this, &QTreeView::customContextMenuRequested, [=](const QPoint&p){
+    QModelIndex src = sourceIndex(currentIndex());
+    compressAction->setEnabled(src.isValid());
+    compressAction->setChecked(src.isValid() &&
+      CacheModel->data(src, AutoRuleModel::CompressRole).toBool());
+    mirrorAction->setEnabled(src.isValid());
+    mirrorAction->setChecked(src.isValid() &&
+      CacheModel->data(src, AutoRuleModel::MirrorRole).toBool());
+    transactionAction->setEnabled(src.isValid());
+    transactionAction->setChecked(src.isValid() &&
+      CacheModel->data(src, AutoRuleModel::TransactionRole).toBool());
 	  m_pMenu->exec(mapToGlobal(p));
   });
 }
@@ -186,7 +224,97 @@ bool AutoRuleView::showAdvanced() const
 
 void AutoRuleView::setSearchFilter(const QString& s)
 {
-  this->SearchFilter->setFilterFixedString(s);
+  this->SearchFilter->setQuery(s);
+}
+
+QModelIndex AutoRuleView::sourceIndex(const QModelIndex& idx) const
+{
+  QModelIndex src =
+    this->AdvancedFilter->mapToSource(this->SearchFilter->mapToSource(idx));
+  if (!src.isValid()) {
+    return src;
+  }
+  return src.sibling(src.row(), 0);
+}
+
+void AutoRuleView::editFilters(const QModelIndex& idx)
+{
+  QModelIndex src = sourceIndex(idx);
+  if (!src.isValid()) {
+    return;
+  }
+  AutoCopyProperty prop;
+  this->CacheModel->getPropertyData(src, prop);
+
+  bool ok = false;
+  QString includes = QInputDialog::getText(
+    this, QString::fromLocal8Bit(""),
+    QString::fromLocal8Bit(" ( *.dll;*.pdb):"), QLineEdit::Normal,
+    RuleFilter::joinPatterns(prop.Includes), &ok);
+  if (!ok) {
+    return;
+  }
+  QString excludes = QInputDialog::getText(
+    this, QString::fromLocal8Bit(""),
+    QString::fromLocal8Bit("ų ( *.tmp;*.obj;.git):"), QLineEdit::Normal,
+    RuleFilter::joinPatterns(prop.Excludes), &ok);
+  if (!ok) {
+    return;
+  }
+  this->CacheModel->setPropertyFilters(src, RuleFilter::splitPatterns(includes),
+                                       RuleFilter::splitPatterns(excludes));
+  emit sig_updateSchedule();
+}
+
+void AutoRuleView::editGroup(const QModelIndex& idx)
+{
+  QModelIndex src = sourceIndex(idx);
+  if (!src.isValid()) {
+    return;
+  }
+  QStringList names;
+  names << QString();
+  foreach (AutoCopyGroup const& group, this->CacheModel->groups()) {
+    names << group.Name;
+  }
+  QString current =
+    this->CacheModel->data(src, AutoRuleModel::RuleGroupRole).toString();
+  bool ok = false;
+  QString group = QInputDialog::getItem(
+    this, QString::fromLocal8Bit(""),
+    QString::fromLocal8Bit(" (a/b Ϊ a ¼):"), names,
+    qMax(0, names.indexOf(current)), true, &ok);
+  if (!ok) {
+    return;
+  }
+  this->CacheModel->setPropertyGroup(src, group.trimmed());
+  emit sig_updateSchedule();
+}
+
+void AutoRuleView::editPolicy(const QModelIndex& idx)
+{
+  QModelIndex src = sourceIndex(idx);
+  if (!src.isValid()) {
+    return;
+  }
+  QString current =
+    this->CacheModel->data(src, AutoRuleModel::PolicyRole).toString();
+  bool ok = false;
+  QString text = QInputDialog::getText(
+    this, QString::fromLocal8Bit("ͬ"),
+    QString::fromLocal8Bit("ʹ÷Ĳ, immediate, debounce:, "
+                           "batch:, window:22:00-06:00"),
+    QLineEdit::Normal, current, &ok);
+  if (!ok) {
+    return;
+  }
+  SyncPolicy policy;
+  if (!text.trimmed().isEmpty() && !SyncPolicy::parse(text, policy)) {
+    return;
+  }
+  this->CacheModel->setPropertyPolicy(
+    src, text.trimmed().isEmpty() ? QString() : policy.toString());
+  emit sig_updateSchedule();
 }
 
 void AutoRuleView::keyPressEvent(QKeyEvent *event) 
@@ -208,14 +336,14 @@ void AutoRuleView::keyPressEvent(QKeyEvent *event)
 }
 
 AutoRuleModel::AutoRuleModel(QObject* p)
-  : QStandardItemModel(p)
+  : QAbstractTableModel(p)
   , EditEnabled(true)
   , NewPropertyCount(0)
+  , Checker(new PathChecker(this))
 {
   this->ShowNewProperties = true;
-  QStringList labels;
-  labels << tr("SOURCE") << tr("TARGET");
-  this->setHorizontalHeaderLabels(labels);
+  connect(this->Checker, SIGNAL(checked(const QStringList&)), this,
+          SLOT(pathsChecked(const QStringList&)));
 }
 
 AutoRuleModel::~AutoRuleModel()
@@ -234,44 +362,262 @@ void AutoRuleModel::setShowNewProperties(bool f)
 
 void AutoRuleModel::clear()
 {
-  this->QStandardItemModel::clear();
+  this->beginResetModel();
+  this->Rules.clear();
+  this->Checker->clear();
+  this->Search.clear();
   this->NewPropertyCount = 0;
+  this->Groups.clear();
+  this->endResetModel();
+}
 
-  QStringList labels;
-  labels << tr("SOURCE") << tr("TARGET");
-  this->setHorizontalHeaderLabels(labels);
+int AutoRuleModel::rowCount(const QModelIndex& parent) const
+{
+  return parent.isValid() ? 0 : this->Rules.size();
 }
 
-void AutoRuleModel::setPropertyData(const QModelIndex& idx1,
-                                       const AutoCopyProperty& prop, bool isNew)
+int AutoRuleModel::columnCount(const QModelIndex& parent) const
 {
-  QModelIndex idx2 = idx1.sibling(idx1.row(),1);
+  return parent.isValid() ? 0 : 2;
+}
 
-  this->setData(idx1, prop.Key, Qt::DisplayRole);
-  this->setData(idx1, prop.Help, AutoRuleModel::HelpRole);
-  this->setData(idx1, prop.KeyType, AutoRuleModel::KeyTypeRole);
-  this->setData(idx1, prop.Advanced, AutoRuleModel::AdvancedRole);
+QVariant AutoRuleModel::headerData(int section, Qt::Orientation orientation,
+                                   int role) const
+{
+  if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+    return section == 0 ? tr("SOURCE") : tr("TARGET");
+  }
+  return QAbstractTableModel::headerData(section, orientation, role);
+}
 
-  if (prop.ValueType == AutoCopyProperty::BOOL) {
-    int check = prop.Value.toBool() ? Qt::Checked : Qt::Unchecked;
-    this->setData(idx2, check, Qt::CheckStateRole);
-  } else {
-    this->setData(idx2, prop.Value, Qt::DisplayRole);
+QVariant AutoRuleModel::pathColor(int row, bool key) const
+{
+  PathChecker::State state = this->Checker->state(
+    this->Rules.text(row, key ? RuleStore::KEY : RuleStore::VALUE));
+  if (state == PathChecker::UNKNOWN) {
+    return QVariant();
+  }
+  bool exists =
+    key ? state != PathChecker::MISSING : state == PathChecker::IS_DIR;
+  return exists ? QColor(255, 255, 255) : QColor(255, 100, 100);
+}
+
+void AutoRuleModel::pathsChecked(const QStringList& paths)
+{
+  // Qt 5.7 proxies ignore the roles and filter every row in the range again,
+  // only the rows that use a changed path are reported
+  QSet<int> ids;
+  for each (const QString& path in paths) {
+    int id = this->Rules.poolId(path);
+    if (id > 0) {
+      ids.insert(id);
+    }
+  }
+  if (ids.isEmpty()) {
+    return;
+  }
+  int rows = this->Rules.size();
+  int first = -1;
+  for (int row = 0; row <= rows; ++row) {
+    bool changed = row < rows &&
+      (ids.contains(this->Rules.textId(row, RuleStore::KEY)) ||
+       ids.contains(this->Rules.textId(row, RuleStore::VALUE)));
+    if (changed && first < 0) {
+      first = row;
+    } else if (!changed && first >= 0) {
+      emit dataChanged(this->index(first, 0), this->index(row - 1, 1),
+                       QVector<int>() << Qt::BackgroundRole);
+      first = -1;
+    }
+  }
+}
+
+void AutoRuleModel::invalidatePath(const QString& path)
+{
+  this->Checker->invalidate(path);
+}
+
+void AutoRuleModel::setSearchQuery(const QString& query)
+{
+  this->Search.setQuery(query);
+}
+
+bool AutoRuleModel::searchMatches(int row) const
+{
+  return row < 0 || row >= this->Rules.size() ||
+    this->Search.matches(this->Rules.id(row));
+}
+
+void AutoRuleModel::indexRow(int row)
+{
+  this->Search.add(this->Rules.id(row),
+                   this->Rules.text(row, RuleStore::KEY),
+                   this->Rules.text(row, RuleStore::VALUE));
+}
+
+QVariant AutoRuleModel::data(const QModelIndex& idx, int role) const
+{
+  if (!idx.isValid() || idx.row() >= this->Rules.size()) {
+    return QVariant();
+  }
+  int row = idx.row();
+  bool key = idx.column() == 0;
+  bool checkable = this->Rules.valueType(row) == AutoCopyProperty::BOOL;
+
+  // roles of both columns, the value column carries the value type
+  switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+      if (key) {
+        return this->Rules.text(row, RuleStore::KEY);
+      }
+      return checkable ? QVariant()
+                       : QVariant(this->Rules.text(row, RuleStore::VALUE));
+    case Qt::CheckStateRole:
+      if (key || !checkable) {
+        return QVariant();
+      }
+      return this->Rules.flag(row, RuleStore::CHECKED) ? Qt::Checked
+                                                       : Qt::Unchecked;
+    case HelpRole:
+      return this->Rules.text(row, RuleStore::HELP);
+    case Qt::BackgroundRole:
+      return this->pathColor(row, key);
+    case KeyTypeRole:
+      return key ? QVariant(int(this->Rules.keyType(row))) : QVariant();
+    case ValueTypeRole:
+      return key ? QVariant() : QVariant(int(this->Rules.valueType(row)));
+  }
+  if (!key) {
+    return QVariant();
+  }
+
+  // rule settings live on the key column
+  switch (role) {
+    case AdvancedRole:
+      return this->Rules.flag(row, RuleStore::ADVANCED);
+    case StringsRole: {
+      QStringList strings = this->Rules.list(row, RuleStore::STRINGS);
+      return strings.isEmpty() ? QVariant() : QVariant(strings);
+    }
+    case IncludeRole:
+      return this->Rules.list(row, RuleStore::INCLUDES);
+    case ExcludeRole:
+      return this->Rules.list(row, RuleStore::EXCLUDES);
+    case CompressRole:
+      return this->Rules.flag(row, RuleStore::COMPRESS);
+    case MirrorRole:
+      return this->Rules.flag(row, RuleStore::MIRROR);
+    case RuleGroupRole:
+      return this->Rules.text(row, RuleStore::GROUP);
+    case PolicyRole:
+      return this->Rules.text(row, RuleStore::POLICY);
+    case TransactionRole:
+      return this->Rules.flag(row, RuleStore::TRANSACTION);
+    case PublishOrderRole:
+      return this->Rules.list(row, RuleStore::PUBLISH_ORDER);
+  }
+  return QVariant();
+}
+
+bool AutoRuleModel::setData(const QModelIndex& idx, const QVariant& value,
+                            int role)
+{
+  if (!idx.isValid() || idx.row() >= this->Rules.size()) {
+    return false;
   }
-  this->setData(idx2, prop.ValueType, AutoRuleModel::ValueTypeRole);
-  this->setData(idx2, prop.Help, AutoRuleModel::HelpRole);
+  int row = idx.row();
+  bool key = idx.column() == 0;
+  switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+      if (key) {
+        this->Rules.setText(row, RuleStore::KEY, value.toString());
+      } else if (this->Rules.valueType(row) == AutoCopyProperty::BOOL) {
+        this->Rules.setFlag(row, RuleStore::CHECKED, value.toBool());
+      } else {
+        this->Rules.setText(row, RuleStore::VALUE, value.toString());
+      }
+      this->indexRow(row);
+      break;
+    case Qt::CheckStateRole:
+      if (key) {
+        return false;
+      }
+      this->Rules.setFlag(row, RuleStore::CHECKED,
+                          value.toInt() == Qt::Checked);
+      break;
+    case HelpRole:
+      this->Rules.setText(row, RuleStore::HELP, value.toString());
+      break;
+    case KeyTypeRole:
+      this->Rules.setKeyType(
+        row, static_cast<AutoCopyProperty::PropertyType>(value.toInt()));
+      break;
+    case ValueTypeRole:
+      this->Rules.setValueType(
+        row, static_cast<AutoCopyProperty::PropertyType>(value.toInt()));
+      break;
+    case AdvancedRole:
+      this->Rules.setFlag(row, RuleStore::ADVANCED, value.toBool());
+      break;
+    case StringsRole:
+      this->Rules.setList(row, RuleStore::STRINGS, value.toStringList());
+      break;
+    case IncludeRole:
+      this->Rules.setList(row, RuleStore::INCLUDES, value.toStringList());
+      break;
+    case ExcludeRole:
+      this->Rules.setList(row, RuleStore::EXCLUDES, value.toStringList());
+      break;
+    case CompressRole:
+      this->Rules.setFlag(row, RuleStore::COMPRESS, value.toBool());
+      break;
+    case MirrorRole:
+      this->Rules.setFlag(row, RuleStore::MIRROR, value.toBool());
+      break;
+    case RuleGroupRole:
+      this->Rules.setText(row, RuleStore::GROUP, value.toString());
+      break;
+    case PolicyRole:
+      this->Rules.setText(row, RuleStore::POLICY, value.toString());
+      break;
+    case TransactionRole:
+      this->Rules.setFlag(row, RuleStore::TRANSACTION, value.toBool());
+      break;
+    case PublishOrderRole:
+      this->Rules.setList(row, RuleStore::PUBLISH_ORDER,
+                          value.toStringList());
+      break;
+    default:
+      return false;
+  }
+  emit dataChanged(this->index(row, 0), this->index(row, 1));
+  return true;
+}
 
-  if (!prop.Strings.isEmpty()) {
-    this->setData(idx1, prop.Strings, AutoRuleModel::StringsRole);
+bool AutoRuleModel::removeRows(int row, int count, const QModelIndex& parent)
+{
+  if (parent.isValid() || row < 0 || count <= 0 ||
+      row + count > this->Rules.size()) {
+    return false;
   }
+  this->beginRemoveRows(parent, row, row + count - 1);
+  for (int i = row; i < row + count; ++i) {
+    this->Search.remove(this->Rules.id(i));
+  }
+  this->Rules.remove(row, count);
+  this->endRemoveRows();
+  return true;
+}
 
-  QFileInfo keyInfo(prop.Key);
-  this->setData(idx1,
-	  (keyInfo.isFile() || keyInfo.isDir()) ? QColor(255, 255, 255) :
-	  QColor(255, 100, 100), Qt::BackgroundRole);
-  QFileInfo valInfo(prop.Value.toString());
-  this->setData(idx2,
-	  valInfo.isDir() ? QColor(255, 255, 255) : QColor(255, 100, 100), Qt::BackgroundRole);
+void AutoRuleModel::setPropertyData(const QModelIndex& idx1,
+                                       const AutoCopyProperty& prop, bool isNew)
+{
+  int row = idx1.row();
+  this->Rules.set(row, prop);
+  this->indexRow(row);
+  emit dataChanged(this->index(row, 0), this->index(row, 1));
 
   Q_UNUSED(isNew);
 }
@@ -281,38 +627,81 @@ void AutoRuleModel::updatePropertyAdvance()
 	int nRow = this->rowCount();
 	for (int i = 0; i < nRow;++i)
 	{
-		this->setData(this->index(i,0), true, AutoRuleModel::AdvancedRole);
+		this->Rules.setFlag(i, RuleStore::ADVANCED, true);
 	}
+	if (nRow > 0)
+	{
+		emit dataChanged(this->index(0, 0), this->index(nRow - 1, 1));
+	}
+}
+
+void AutoRuleModel::setPropertyFilters(const QModelIndex& idx,
+                                       const QStringList& includes,
+                                       const QStringList& excludes)
+{
+  QModelIndex idx1 = idx.sibling(idx.row(), 0);
+  this->setData(idx1, includes, AutoRuleModel::IncludeRole);
+  this->setData(idx1, excludes, AutoRuleModel::ExcludeRole);
+}
+
+void AutoRuleModel::setPropertyCompress(const QModelIndex& idx, bool compress)
+{
+  QModelIndex idx1 = idx.sibling(idx.row(), 0);
+  this->setData(idx1, compress, AutoRuleModel::CompressRole);
+}
+
+void AutoRuleModel::setPropertyMirror(const QModelIndex& idx, bool mirror)
+{
+  QModelIndex idx1 = idx.sibling(idx.row(), 0);
+  this->setData(idx1, mirror, AutoRuleModel::MirrorRole);
+}
+
+void AutoRuleModel::setPropertyTransaction(const QModelIndex& idx, bool transaction)
+{
+  QModelIndex idx1 = idx.sibling(idx.row(), 0);
+  this->setData(idx1, transaction, AutoRuleModel::TransactionRole);
+}
+
+void AutoRuleModel::setPropertyPolicy(const QModelIndex& idx, const QString& policy)
+{
+  QModelIndex idx1 = idx.sibling(idx.row(), 0);
+  this->setData(idx1, policy, AutoRuleModel::PolicyRole);
+}
+
+void AutoRuleModel::setPropertyGroup(const QModelIndex& idx, const QString& group)
+{
+  QModelIndex idx1 = idx.sibling(idx.row(), 0);
+  this->setData(idx1, group, AutoRuleModel::RuleGroupRole);
+  if (group.isEmpty()) {
+    return;
+  }
+  foreach (AutoCopyGroup const& g, this->Groups) {
+    if (g.Name == group) {
+      return;
+    }
+  }
+  AutoCopyGroup g;
+  g.Name = group;
+  this->Groups.append(g);
+}
+
+AutoCopyGroupList AutoRuleModel::groups() const
+{
+  return this->Groups;
+}
+
+void AutoRuleModel::setGroups(const AutoCopyGroupList& groups)
+{
+  this->Groups = groups;
 }
 
 void AutoRuleModel::getPropertyData(const QModelIndex& idx1,
 	AutoCopyProperty& prop)  const
 {
-  QModelIndex idx2 = idx1.sibling(idx1.row(), 1);
-
-  prop.Key = this->data(idx1, Qt::DisplayRole).toString();
-  prop.Help = this->data(idx1, HelpRole).toString();
-  prop.KeyType = static_cast<AutoCopyProperty::PropertyType>(
-    this->data(idx1, KeyTypeRole).toInt());
-  prop.ValueType = static_cast<AutoCopyProperty::PropertyType>(
-	  this->data(idx2, ValueTypeRole).toInt());
-  prop.Advanced = this->data(idx1, AdvancedRole).toBool();
-  prop.Strings =
-    this->data(idx1, AutoRuleModel::StringsRole).toStringList();
-  if (prop.ValueType == AutoCopyProperty::BOOL) {
-    int check = this->data(idx2, Qt::CheckStateRole).toInt();
-	prop.Value = check == Qt::Checked;	
-  } else {
-    prop.Value = this->data(idx2, Qt::DisplayRole).toString();
+  if (!idx1.isValid() || idx1.row() >= this->Rules.size()) {
+    return;
   }
- 
-  QFileInfo keyInfo(prop.Key);
-  const_cast<AutoRuleModel*>(this)->setData(idx1,
-	  (keyInfo.isFile()|| keyInfo.isDir()) ? QColor(255, 255, 255) :
-	  QColor(255, 100, 100), Qt::BackgroundRole);
-  QFileInfo valInfo(prop.Value.toString());
-  const_cast<AutoRuleModel*>(this)->setData(idx2, 
-	  valInfo.isDir() ? QColor(255, 255, 255) : QColor(255, 100, 100), Qt::BackgroundRole);
+  prop = this->Rules.at(idx1.row());
 }
 
 QString AutoRuleModel::prefix(const QString& s)
@@ -353,46 +742,12 @@ void AutoRuleModel::breakProperties(
 
 AutoCopyPropertyList AutoRuleModel::properties() const
 {
-  AutoCopyPropertyList props;
-
-  if (!this->rowCount()) {
-    return props;
-  }
-
-  QVector<QModelIndex> idxs;
-  idxs.append(this->index(0, 0));
-
-  // walk the entire model for property entries
-  // this works regardless of a flat view or a tree view
-  while (!idxs.isEmpty()) {
-    QModelIndex idx = idxs.last();
-    if (this->hasChildren(idx) && this->rowCount(idx)) {
-      idxs.append(this->index(0, 0, idx));
-    } else {
-      if (!data(idx, GroupRole).toInt()) {
-        // get data
-        AutoCopyProperty prop;
-        this->getPropertyData(idx, prop);
-        props.append(prop);
-      }
-
-      // go to the next in the tree
-      while (!idxs.isEmpty() &&
-             (
-#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0) &&                                \
-  QT_VERSION < QT_VERSION_CHECK(5, 1, 0)
-               (idxs.last().row() + 1) >= rowCount(idxs.last().parent()) ||
-#endif
-               !idxs.last().sibling(idxs.last().row() + 1, 0).isValid())) {
-        idxs.remove(idxs.size() - 1);
-      }
-      if (!idxs.isEmpty()) {
-        idxs.last() = idxs.last().sibling(idxs.last().row() + 1, 0);
-      }
-    }
-  }
+  return this->Rules.properties();
+}
 
-  return props;
+RuleStore AutoRuleModel::snapshot() const
+{
+  return this->Rules;
 }
 
 bool AutoRuleModel::insertProperty(AutoCopyProperty::PropertyType keyt,
@@ -407,14 +762,37 @@ bool AutoRuleModel::insertProperty(AutoCopyProperty::PropertyType keyt,
   prop.ValueType = valuet;
   prop.Help = description;
   prop.Advanced = advanced;
+  return this->insertProperty(prop);
+}
 
+bool AutoRuleModel::insertProperty(const AutoCopyProperty& prop)
+{
   // insert at beginning
-  this->insertRow(0);
-  this->setPropertyData(this->index(0, 0), prop, true);
+  this->beginInsertRows(QModelIndex(), 0, 0);
+  this->Rules.insert(0, prop);
+  this->indexRow(0);
+  this->endInsertRows();
   this->NewPropertyCount++;
   return true;
 }
 
+bool AutoRuleModel::insertProperties(const AutoCopyPropertyList& props)
+{
+  if (props.isEmpty()) {
+    return true;
+  }
+  // append at the end, the store grows without moving the existing rows
+  int first = this->Rules.size();
+  this->beginInsertRows(QModelIndex(), first, first + props.size() - 1);
+  for (int i = 0; i < props.size(); ++i) {
+    this->Rules.insert(first + i, props.at(i));
+    this->indexRow(first + i);
+  }
+  this->endInsertRows();
+  this->NewPropertyCount += props.size();
+  return true;
+}
+
 void AutoRuleModel::setEditEnabled(bool e)
 {
   this->EditEnabled = e;
@@ -432,7 +810,10 @@ int AutoRuleModel::newPropertyCount() const
 
 Qt::ItemFlags AutoRuleModel::flags(const QModelIndex& idx) const
 {
-  Qt::ItemFlags f = QStandardItemModel::flags(idx);
+  if (!idx.isValid()) {
+    return Qt::ItemFlags();
+  }
+  Qt::ItemFlags f = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable;
   if (!this->EditEnabled) {
     f &= ~Qt::ItemIsEditable;
     return f;
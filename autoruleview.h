@@ -3,16 +3,21 @@
 #ifndef QCMakeCacheView_h
 #define QCMakeCacheView_h
 
+#include <QAbstractTableModel>
 #include <QItemDelegate>
+#include <QMap>
 #include <QSet>
-#include <QStandardItemModel>
 #include <QTreeView>
 
 #include "autocopy.h"
+#include "rulestore.h"
+#include "rulesearchindex.h"
 
 class QSortFilterProxyModel;
+class PathChecker;
 class AutoRuleModel;
 class RuleAdvancedFilter;
+class RuleSearchFilter;
 
 /// Qt view class for cache properties
 class AutoRuleView : public QTreeView
@@ -44,18 +49,25 @@ signals:
 protected:
   QModelIndex moveCursor(CursorAction, Qt::KeyboardModifiers);
   bool event(QEvent* e);
+  void editFilters(const QModelIndex& idx);
+  void editGroup(const QModelIndex& idx);
+  void editPolicy(const QModelIndex& idx);
+  QModelIndex sourceIndex(const QModelIndex& idx) const;
   AutoRuleModel* CacheModel;
   RuleAdvancedFilter* AdvancedFilter;
-  QSortFilterProxyModel* SearchFilter;
+  RuleSearchFilter* SearchFilter;
   QMenu* m_pMenu;
 };
 
-/// Qt model class for cache properties
-class AutoRuleModel : public QStandardItemModel
+/// Qt model class for cache properties, a flat table over a RuleStore.
+/// cells are produced on request, only the rows the view draws are touched.
+/// rows whose paths do not exist are red, the checks run on a PathChecker and
+/// a row keeps the default background until its result is in
+class AutoRuleModel : public QAbstractTableModel
 {
   Q_OBJECT
 public:
-  AutoRuleModel(QObject* parent);
+  AutoRuleModel(QObject* parent = nullptr);
   ~AutoRuleModel();
 
   // roles used to retrieve extra data such has help strings, types of
@@ -67,7 +79,15 @@ public:
     ValueTypeRole,
     AdvancedRole,
     StringsRole,
-    GroupRole
+    GroupRole,
+    IncludeRole,
+    ExcludeRole,
+    CompressRole,
+    MirrorRole,
+    RuleGroupRole,
+    PolicyRole,
+    TransactionRole,
+    PublishOrderRole
   };
 
 public slots:
@@ -87,9 +107,25 @@ public slots:
 					  AutoCopyProperty::PropertyType valuet, const QString& name,
                       const QString& description, const QVariant& value,
                       bool advanced);
+  bool insertProperty(const AutoCopyProperty& prop);
+  // append props in their order as one insert, the view lays the new rows
+  // out once. used to import rule files
+  bool insertProperties(const AutoCopyPropertyList& props);
 public:
   // get the properties
 	AutoCopyPropertyList properties() const;
+  // copy of the rule columns, O(1) and unaffected by later edits
+  RuleStore snapshot() const;
+
+  int rowCount(const QModelIndex& parent = QModelIndex()) const;
+  int columnCount(const QModelIndex& parent = QModelIndex()) const;
+  QVariant data(const QModelIndex& idx, int role = Qt::DisplayRole) const;
+  bool setData(const QModelIndex& idx, const QVariant& value,
+               int role = Qt::EditRole);
+  QVariant headerData(int section, Qt::Orientation orientation,
+                      int role = Qt::DisplayRole) const;
+  bool removeRows(int row, int count,
+                  const QModelIndex& parent = QModelIndex());
 
   // editing enabled
   bool editEnabled() const;
@@ -105,10 +141,45 @@ public:
   void getPropertyData(const QModelIndex& idx1, AutoCopyProperty& prop)const;
 
   void updatePropertyAdvance();
+
+  // set the include/exclude globs of the rule at idx
+  void setPropertyFilters(const QModelIndex& idx, const QStringList& includes,
+                          const QStringList& excludes);
+  // set whether the rule at idx writes compressed archives
+  void setPropertyCompress(const QModelIndex& idx, bool compress);
+  // set whether the rule at idx repeats deletes and renames
+  void setPropertyMirror(const QModelIndex& idx, bool mirror);
+  // set whether the rule at idx publishes its changes as batches
+  void setPropertyTransaction(const QModelIndex& idx, bool transaction);
+  // set the sync policy text of the rule at idx, see SyncPolicy
+  void setPropertyPolicy(const QModelIndex& idx, const QString& policy);
+  // move the rule at idx to group, unknown groups are created with defaults
+  void setPropertyGroup(const QModelIndex& idx, const QString& group);
+
+  // the rule groups, kept outside the rows
+  AutoCopyGroupList groups() const;
+  void setGroups(const AutoCopyGroupList& groups);
+
+  // a watcher reported a change at path, its rows are checked again
+  void invalidatePath(const QString& path);
+
+  // search of the rule view, see RuleSearchIndex
+  void setSearchQuery(const QString& query);
+  bool searchMatches(int row) const;
 protected:
   bool EditEnabled;
   int NewPropertyCount;
   bool ShowNewProperties;
+  AutoCopyGroupList Groups;
+  RuleStore Rules;
+  PathChecker* Checker;
+  RuleSearchIndex Search;
+
+  // updates the search index after the key or value of row changed
+  void indexRow(int row);
+
+  // background of the key or value cell of row, invalid while unchecked
+  QVariant pathColor(int row, bool key) const;
 
   // set the data in the model for this property
   void setPropertyData(const QModelIndex& idx1, const AutoCopyProperty& p,
@@ -121,6 +192,10 @@ protected:
 
   // gets the prefix of a string up to the first _
   static QString prefix(const QString& s);
+
+protected slots:
+  // new check results, the rows using paths fetch their colours again
+  void pathsChecked(const QStringList& paths);
 };
 
 /// Qt delegate class for interaction (or other customization)
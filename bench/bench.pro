@@ -0,0 +1,37 @@
+TARGET = AutoCopyBench
+TEMPLATE = app
+CONFIG += console
+QT += core gui widgets xml network
+
+INCLUDEPATH += ..
+SOURCES += benchmain.cpp \
+	../Tools.cpp \
+	../autocopyschedule.cpp \
+	../autoruleview.cpp \
+	../editwidgets.cpp \
+	../rulefilter.cpp \
+	../copylog.cpp \
+	../copylogmodel.cpp \
+	../copyjournal.cpp \
+	../copymetrics.cpp \
+	../copytrace.cpp \
+	../contentstore.cpp \
+	../archivecopy.cpp \
+	../fasthash.cpp \
+	../retrywheel.cpp \
+	../metricsserver.cpp \
+	../pollscanner.cpp \
+	../fanotifywatcher.cpp \
+	../syncpolicy.cpp \
+	../rulestore.cpp \
+	../pathchecker.cpp \
+	../rulesearchindex.cpp
+HEADERS += ../autocopyschedule.h \
+	../autoruleview.h \
+	../editwidgets.h \
+	../copylogmodel.h \
+	../copyjournal.h \
+	../metricsserver.h \
+	../pollscanner.h \
+	../fanotifywatcher.h \
+	../pathchecker.h
@@ -0,0 +1,776 @@
+// AutoCopy benchmark: synthesizes source trees, drives change bursts and
+// writes one JSON document with the results for regression tracking.
+//
+//   AutoCopyBench [--out results.json] [--dir work] [--scale 1.0] [--filter name]
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <winioctl.h>
+#include <io.h>
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+#include "Tools.h"
+#include "BlockingQueue.h"
+#include "groupqueue.h"
+#include "autocopy.h"
+#include "autocopyschedule.h"
+#include "autoruleview.h"
+
+#if defined(COPYFILES_STACTIC)
+#include <QtCore/QtPlugin>
+Q_IMPORT_PLUGIN(QWindowsIntegrationPlugin)
+#endif
+
+// give up waiting for the pipeline after this long
+static const qint64 kPipelineTimeoutMs = 120000;
+
+static double processCpuSeconds()
+{
+#ifdef Q_OS_WIN
+	FILETIME creation, exited, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user))
+		return 0;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return double(k.QuadPart + u.QuadPart) / 1e7;
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+		+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+/// one measured case
+struct BenchResult
+{
+	QString Name;
+	qint64 Items;
+	qint64 Bytes;
+	double Seconds;
+	double CpuSeconds;
+	QVector<double> LatencyMs;	// per item, empty if not measured
+	qint64 AllocatedBytes;		// disk space of the output, -1 if not measured
+
+	BenchResult() : Items(0), Bytes(0), Seconds(0), CpuSeconds(0), AllocatedBytes(-1) {}
+
+	QJsonObject toJson() const
+	{
+		QJsonObject obj;
+		obj.insert("name", Name);
+		obj.insert("items", double(Items));
+		obj.insert("bytes", double(Bytes));
+		obj.insert("seconds", Seconds);
+		obj.insert("items_per_sec", Seconds > 0 ? Items / Seconds : 0);
+		obj.insert("mb_per_sec", Seconds > 0 ? Bytes / 1048576.0 / Seconds : 0);
+		obj.insert("cpu_seconds", CpuSeconds);
+		if (Bytes > 0)
+			obj.insert("cpu_ns_per_byte", CpuSeconds * 1e9 / Bytes);
+		if (AllocatedBytes >= 0)
+			obj.insert("allocated_bytes", double(AllocatedBytes));
+		if (!LatencyMs.isEmpty())
+		{
+			QVector<double> sorted = LatencyMs;
+			std::sort(sorted.begin(), sorted.end());
+			QJsonObject latency;
+			latency.insert("p50", percentile(sorted, 0.50));
+			latency.insert("p90", percentile(sorted, 0.90));
+			latency.insert("p99", percentile(sorted, 0.99));
+			latency.insert("max", sorted.last());
+			obj.insert("latency_ms", latency);
+		}
+		return obj;
+	}
+
+	static double percentile(const QVector<double>& sorted, double q)
+	{
+		int index = qMin(sorted.size() - 1, int(q * sorted.size()));
+		return sorted.at(index);
+	}
+};
+
+/// starts the wall and cpu clocks of a case
+class BenchClock
+{
+public:
+	BenchClock() : m_cpu(processCpuSeconds()) { m_wall.start(); }
+	void stop(BenchResult& result) const
+	{
+		result.Seconds = m_wall.nsecsElapsed() / 1e9;
+		result.CpuSeconds = processCpuSeconds() - m_cpu;
+	}
+private:
+	QElapsedTimer m_wall;
+	double m_cpu;
+};
+
+/// a synthesized source tree
+struct BenchTree
+{
+	QString Name;
+	QString Root;
+	QStringList Files;
+	qint64 Bytes;
+	BenchTree() : Bytes(0) {}
+};
+
+static bool writeFile(const QString& path, qint64 size, int seed)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	QByteArray block(qMin<qint64>(size, 1024 * 1024), Qt::Uninitialized);
+	for (int i = 0; i < block.size(); ++i)
+		block[i] = char((i * 31 + seed) & 0xff);
+	qint64 left = size;
+	while (left > 0)
+	{
+		qint64 n = qMin<qint64>(left, block.size());
+		if (file.write(block.constData(), n) != n)
+			return false;
+		left -= n;
+	}
+	return true;
+}
+
+// size bytes with a dataBytes block at the start of every stride, the rest
+// are holes
+static bool writeSparseFile(const QString& path, qint64 size, qint64 stride, qint64 dataBytes,
+	int seed)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+#ifdef Q_OS_WIN
+	DWORD bytes = 0;
+	DeviceIoControl((HANDLE)_get_osfhandle(file.handle()), FSCTL_SET_SPARSE, nullptr, 0,
+		nullptr, 0, &bytes, nullptr);
+#endif
+	QByteArray block(int(dataBytes), Qt::Uninitialized);
+	for (int i = 0; i < block.size(); ++i)
+		block[i] = char((i * 31 + seed) & 0xff);
+	for (qint64 offset = 0; offset < size; offset += stride)
+	{
+		qint64 n = qMin<qint64>(dataBytes, size - offset);
+		if (!file.seek(offset) || file.write(block.constData(), n) != n)
+			return false;
+	}
+	return file.resize(size);
+}
+
+// disk space actually used by a file
+static qint64 allocatedBytes(const QString& path)
+{
+#ifdef Q_OS_WIN
+	DWORD high = 0;
+	DWORD low = GetCompressedFileSizeW((const wchar_t*)QDir::toNativeSeparators(path).utf16(), &high);
+	if (low == INVALID_FILE_SIZE && GetLastError() != NO_ERROR)
+		return 0;
+	return (qint64(high) << 32) | low;
+#else
+	struct stat st;
+	if (stat(QFile::encodeName(path).constData(), &st) != 0)
+		return 0;
+	return qint64(st.st_blocks) * 512;
+#endif
+}
+
+static BenchTree makeSparseTree(const QString& root, int files, qint64 size)
+{
+	BenchTree tree;
+	tree.Name = "sparse";
+	tree.Root = root + "/sparse";
+	QDir().mkpath(tree.Root);
+	for (int i = 0; i < files; ++i)
+	{
+		// 1 MiB of data every 32 MiB, like a mostly empty disk image
+		QString path = QString("%1/s%2.img").arg(tree.Root).arg(i);
+		writeSparseFile(path, size, 32 * 1024 * 1024, 1024 * 1024, i);
+		tree.Files << path;
+		tree.Bytes += size;
+	}
+	return tree;
+}
+
+static BenchTree makeFlatTree(const QString& root, const QString& name, int files, qint64 size)
+{
+	BenchTree tree;
+	tree.Name = name;
+	tree.Root = root + "/" + name;
+	QDir().mkpath(tree.Root);
+	for (int i = 0; i < files; ++i)
+	{
+		QString path = QString("%1/f%2.bin").arg(tree.Root).arg(i, 6, 10, QChar('0'));
+		writeFile(path, size, i);
+		tree.Files << path;
+		tree.Bytes += size;
+	}
+	return tree;
+}
+
+// a chain of depth directories, every level holding filesPerDir files
+static BenchTree makeDeepTree(const QString& root, int depth, int filesPerDir, qint64 size)
+{
+	BenchTree tree;
+	tree.Name = "deep";
+	tree.Root = root + "/deep";
+	QString dir = tree.Root;
+	for (int d = 0; d < depth; ++d)
+	{
+		dir += QString("/level%1").arg(d);
+		QDir().mkpath(dir);
+		for (int i = 0; i < filesPerDir; ++i)
+		{
+			QString path = QString("%1/d%2_f%3.bin").arg(dir).arg(d).arg(i);
+			writeFile(path, size, d * filesPerDir + i);
+			tree.Files << path;
+			tree.Bytes += size;
+		}
+	}
+	return tree;
+}
+
+static qint64 scaled(double scale, qint64 n)
+{
+	return qMax<qint64>(1, qint64(n * scale));
+}
+
+// CTools::copyFileToPath alone: a cold pass into an empty destination and
+// a second pass where every destination is already up to date
+static QList<BenchResult> benchCopyFileToPath(const BenchTree& tree, const QString& work)
+{
+	QList<BenchResult> results;
+	QString dest = work + "/copy_" + tree.Name;
+	QDir(dest).removeRecursively();
+
+	const char* passes[] = { "cold", "uptodate" };
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		BenchResult result;
+		result.Name = QString("copyFileToPath/%1/%2").arg(tree.Name).arg(passes[pass]);
+		BenchClock clock;
+		for each (const QString& file in tree.Files)
+		{
+			QString error;
+			CTools::CopyStats stats;
+			CTools::copyFileToPath(file, dest, error, true, &stats);
+			result.Bytes += stats.Bytes;
+			++result.Items;
+		}
+		clock.stop(result);
+		results << result;
+	}
+	return results;
+}
+
+// the cold pass of copyFileToPath with Copy/Verify on: the .part is read
+// back and compared with the hash of the written bytes before it is
+// published, compare with copyFileToPath/<tree>/cold for the cost
+static BenchResult benchVerifiedCopy(const BenchTree& tree, const QString& work)
+{
+	QString dest = work + "/verify_" + tree.Name;
+	QDir(dest).removeRecursively();
+	bool verify = CTools::verifyCopies();
+	CTools::setVerifyCopies(true);
+	BenchResult result;
+	result.Name = QString("copyFileToPath/%1/cold+verify").arg(tree.Name);
+	BenchClock clock;
+	for each (const QString& file in tree.Files)
+	{
+		QString error;
+		CTools::CopyStats stats;
+		CTools::copyFileToPath(file, dest, error, true, &stats);
+		result.Bytes += stats.Bytes;
+		++result.Items;
+	}
+	clock.stop(result);
+	CTools::setVerifyCopies(verify);
+	return result;
+}
+
+// copyFileToPath on sparse sources, allocated_bytes should stay near the
+// data blocks instead of the file size
+static BenchResult benchSparse(const BenchTree& tree, const QString& work)
+{
+	QString dest = work + "/copy_" + tree.Name;
+	QDir(dest).removeRecursively();
+	BenchResult result;
+	result.Name = QString("copyFileToPath/%1/cold").arg(tree.Name);
+	BenchClock clock;
+	for each (const QString& file in tree.Files)
+	{
+		QString error;
+		CTools::CopyStats stats;
+		CTools::copyFileToPath(file, dest, error, true, &stats);
+		result.Bytes += stats.Bytes;
+		++result.Items;
+	}
+	clock.stop(result);
+	result.AllocatedBytes = 0;
+	for each (const QString& file in tree.Files)
+		result.AllocatedBytes += allocatedBytes(dest + "/" + QFileInfo(file).fileName());
+	return result;
+}
+
+// one source into several destinations, read once by copyFileToPaths
+static BenchResult benchFanOut(const BenchTree& tree, const QString& work, int destCount)
+{
+	QStringList dests;
+	for (int i = 0; i < destCount; ++i)
+	{
+		dests << QString("%1/fanout_%2/out%3").arg(work).arg(tree.Name).arg(i);
+		QDir(dests.last()).removeRecursively();
+	}
+	BenchResult result;
+	result.Name = QString("copyFileToPaths/%1/%2dests").arg(tree.Name).arg(destCount);
+	BenchClock clock;
+	for each (const QString& file in tree.Files)
+	{
+		QStringList errors;
+		QList<CTools::CopyStats> stats;
+		CTools::copyFileToPaths(file, dests, errors, stats, true);
+		for each (const CTools::CopyStats& s in stats)
+			result.Bytes += s.Bytes;
+		++result.Items;
+	}
+	clock.stop(result);
+	return result;
+}
+
+// rule matching and filtering of AutoCopySchedule::checkCopyFile
+static BenchResult benchCheckCopyFile(const QString& work, int ruleCount, int lookups)
+{
+	QString rulesRoot = work + "/rules";
+	AutoRuleModel* model = new AutoRuleModel;
+	AutoCopyPropertyList props;
+	for (int i = 0; i < ruleCount; ++i)
+	{
+		QString src = QString("%1/r%2").arg(rulesRoot).arg(i);
+		QDir().mkpath(src);
+		AutoCopyProperty prop;
+		prop.Key = src;
+		prop.KeyType = AutoCopyProperty::FILE_PATH;
+		prop.Value = QString("%1/out%2").arg(work).arg(i);
+		prop.ValueType = AutoCopyProperty::PATH;
+		prop.Advanced = true;
+		if (i % 2)
+			prop.Excludes << "*.tmp" << ".git";
+		if (i % 3 == 0)
+			prop.Includes << "*.dll" << "*.so" << "*.bin";
+		props << prop;
+	}
+	model->insertProperties(props);
+	// the schedule and its rules live until exit, its thread stays blocked
+	// on the empty queue
+	AutoCopySchedule* schedule = new AutoCopySchedule(model);
+	model->setParent(schedule);
+	schedule->createWatcher();
+
+	QStringList paths;
+	for (int i = 0; i < 1024; ++i)
+	{
+		paths << QString("%1/r%2/sub%3/deeper/file%4.%5").arg(rulesRoot)
+			.arg(i % ruleCount).arg(i % 7).arg(i)
+			.arg(i % 4 == 0 ? "tmp" : "bin");
+	}
+
+	BenchResult result;
+	result.Name = QString("checkCopyFile/%1rules").arg(ruleCount);
+	qint64 matched = 0;
+	BenchClock clock;
+	for (int i = 0; i < lookups; ++i)
+		matched += schedule->checkCopyFile(paths.at(i % paths.size())).size();
+	clock.stop(result);
+	result.Items = lookups;
+	Q_UNUSED(matched);
+	return result;
+}
+
+class QueueProducer : public QThread
+{
+public:
+	QueueProducer(BlockingQueue<int>* queue, int count) : m_queue(queue), m_count(count) {}
+protected:
+	void run()
+	{
+		for (int i = 1; i <= m_count; ++i)
+			m_queue->put(i);
+	}
+private:
+	BlockingQueue<int>* m_queue;
+	int m_count;
+};
+
+// BlockingQueue configured like the schedule queue
+static BenchResult benchBlockingQueue(int producers, int itemsPerProducer)
+{
+	BlockingQueue<int> queue;
+	queue.setCapacity(4096);
+	queue.setThreshold(1);
+	QList<QueueProducer*> threads;
+	for (int i = 0; i < producers; ++i)
+		threads << new QueueProducer(&queue, itemsPerProducer);
+
+	BenchResult result;
+	result.Name = QString("BlockingQueue/%1producers").arg(producers);
+	BenchClock clock;
+	for each (QueueProducer* t in threads)
+		t->start();
+	qint64 total = qint64(producers) * itemsPerProducer;
+	for (qint64 taken = 0; taken < total; ++taken)
+		queue.take();
+	clock.stop(result);
+	result.Items = total;
+	for each (QueueProducer* t in threads)
+	{
+		t->wait();
+		delete t;
+	}
+	return result;
+}
+
+class LaneProducer : public QThread
+{
+public:
+	LaneProducer(GroupQueue* queue, int lane, int count) : m_queue(queue), m_lane(lane), m_count(count) {}
+protected:
+	void run()
+	{
+		for (int i = 1; i <= m_count; ++i)
+			m_queue->put(QueuedTask(nullptr, m_lane, 0));
+	}
+private:
+	GroupQueue* m_queue;
+	int m_lane;
+	int m_count;
+};
+
+// the schedule queue with one producer per lane, lane i has weight i + 1
+static BenchResult benchGroupQueue(int lanes, int itemsPerLane)
+{
+	GroupQueue queue;
+	queue.setCapacity(4096);
+	queue.setThreshold(1);
+	QVector<QueueShare> shares(lanes);
+	for (int i = 0; i < lanes; ++i)
+	{
+		shares[i].Name = QString::number(i);
+		shares[i].Weight = i + 1;
+	}
+	queue.setShares(shares);
+	QList<LaneProducer*> threads;
+	for (int i = 0; i < lanes; ++i)
+		threads << new LaneProducer(&queue, i, itemsPerLane);
+
+	BenchResult result;
+	result.Name = QString("GroupQueue/%1lanes").arg(lanes);
+	BenchClock clock;
+	for each (LaneProducer* t in threads)
+		t->start();
+	qint64 total = qint64(lanes) * itemsPerLane;
+	for (qint64 taken = 0; taken < total; ++taken)
+		queue.take();
+	clock.stop(result);
+	result.Items = total;
+	for each (LaneProducer* t in threads)
+	{
+		t->wait();
+		delete t;
+	}
+	return result;
+}
+
+/// waits until every destination of the tree has the expected size and
+/// records when each one first did
+class DestinationWatch
+{
+public:
+	DestinationWatch(const BenchTree& tree, const QString& dest)
+	{
+		for each (const QString& file in tree.Files)
+			m_dests << dest + "/" + QFileInfo(file).fileName();
+	}
+
+	// startMs: per file time of the change, relative to clock
+	bool wait(const QElapsedTimer& clock, const QVector<qint64>& startMs,
+		const QVector<qint64>& sizes, BenchResult& result)
+	{
+		int cursor = 0;
+		QVector<bool> done(m_dests.size(), false);
+		int remaining = m_dests.size();
+		while (remaining > 0)
+		{
+			if (clock.elapsed() - startMs.first() > kPipelineTimeoutMs)
+				return false;
+			QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+			// copies run in queue order, look ahead a little past the cursor
+			for (int i = cursor; i < qMin(cursor + 64, m_dests.size()); ++i)
+			{
+				if (done[i] || QFileInfo(m_dests.at(i)).size() != sizes.at(i))
+					continue;
+				done[i] = true;
+				--remaining;
+				result.LatencyMs << double(clock.elapsed() - startMs.at(i));
+			}
+			while (cursor < done.size() && done[cursor])
+				++cursor;
+			QThread::usleep(200);
+		}
+		return true;
+	}
+
+private:
+	QStringList m_dests;
+};
+
+// search box of the rule view: the query is typed one key at a time into
+// AutoRuleView::setSearchFilter, every keystroke narrows the previous one.
+// a keystroke is timed through the search index and both filter proxies
+static BenchResult benchRuleSearch(int ruleCount)
+{
+	AutoRuleView view(nullptr);
+	AutoRuleModel* model = view.cacheModel();
+	AutoCopyProperty prop;
+	prop.KeyType = AutoCopyProperty::FILE_PATH;
+	prop.ValueType = AutoCopyProperty::PATH;
+	prop.Advanced = false;
+	AutoCopyPropertyList props;
+	for (int i = 0; i < ruleCount; ++i)
+	{
+		prop.Key = QString("D:/work/project%1/module%2/bin").arg(i % 997).arg(i);
+		prop.Value = QString("//share/deploy/project%1/module%2").arg(i % 997).arg(i);
+		props << prop;
+	}
+	model->insertProperties(props);
+
+	BenchResult result;
+	result.Name = QString("RuleSearch/%1rules").arg(ruleCount);
+	const QString query = "project42/module1";
+	BenchClock clock;
+	for (int n = 1; n <= query.size(); ++n)
+	{
+		QElapsedTimer key;
+		key.start();
+		view.setSearchFilter(query.left(n));
+		result.LatencyMs << key.nsecsElapsed() / 1e6;
+	}
+	clock.stop(result);
+	result.Items = query.size();
+	return result;
+}
+
+// the whole watcher -> queue -> copy pipeline: the initial sync of the
+// tree, then a burst rewriting every file with a new size
+static QList<BenchResult> benchPipeline(const BenchTree& tree, const QString& work)
+{
+	QList<BenchResult> results;
+	QString dest = work + "/pipeline_" + tree.Name;
+	QDir(dest).removeRecursively();
+	QDir().mkpath(dest);
+
+	AutoRuleModel* model = new AutoRuleModel;
+	AutoCopyProperty prop;
+	prop.Key = tree.Root;
+	prop.KeyType = AutoCopyProperty::FILE_PATH;
+	prop.Value = dest;
+	prop.ValueType = AutoCopyProperty::PATH;
+	prop.Advanced = false;
+	model->insertProperty(prop);
+
+	DestinationWatch watch(tree, dest);
+	QVector<qint64> sizes;
+	for each (const QString& file in tree.Files)
+		sizes << QFileInfo(file).size();
+
+	QElapsedTimer clock;
+	clock.start();
+	// kept watching until exit, like the checkCopyFile case
+	AutoCopySchedule* schedule = new AutoCopySchedule(model);
+	model->setParent(schedule);
+
+	BenchResult initial;
+	initial.Name = QString("pipeline/%1/initial").arg(tree.Name);
+	{
+		BenchClock bench;
+		schedule->createWatcher();
+		QVector<qint64> start(tree.Files.size(), 0);
+		if (!watch.wait(clock, start, sizes, initial))
+			initial.Name += "/timeout";
+		bench.stop(initial);
+	}
+	initial.Items = tree.Files.size();
+	initial.Bytes = tree.Bytes;
+	results << initial;
+
+	BenchResult burst;
+	burst.Name = QString("pipeline/%1/burst").arg(tree.Name);
+	{
+		BenchClock bench;
+		QVector<qint64> start;
+		for (int i = 0; i < tree.Files.size(); ++i)
+		{
+			sizes[i] += 1;
+			start << clock.elapsed();
+			writeFile(tree.Files.at(i), sizes.at(i), i + 1);
+			burst.Bytes += sizes.at(i);
+		}
+		if (!watch.wait(clock, start, sizes, burst))
+			burst.Name += "/timeout";
+		bench.stop(burst);
+	}
+	burst.Items = tree.Files.size();
+	results << burst;
+	return results;
+}
+
+int main(int argc, char *argv[])
+{
+	QApplication a(argc, argv);
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	QCommandLineOption outOption("out", "Write the JSON results to <file>.", "file");
+	QCommandLineOption dirOption("dir", "Create the source trees in <dir>.", "dir");
+	QCommandLineOption scaleOption("scale", "Multiply file counts by <factor>.", "factor", "1");
+	QCommandLineOption filterOption("filter", "Only run cases whose name contains <text>.", "text");
+	parser.addOption(outOption);
+	parser.addOption(dirOption);
+	parser.addOption(scaleOption);
+	parser.addOption(filterOption);
+	parser.process(a);
+
+	double scale = qMax(0.01, parser.value(scaleOption).toDouble());
+	QString filter = parser.value(filterOption);
+	QTemporaryDir tempDir;
+	QString work = parser.isSet(dirOption) ? parser.value(dirOption) : tempDir.path();
+	QDir().mkpath(work);
+	QString sources = work + "/src";
+
+	// the schedules of the cases read a settings file of their own, with the
+	// options the results depend on pinned, and write nothing to AppData
+	QStandardPaths::setTestModeEnabled(true);
+	QString settingsFile = work + "/settings.ini";
+	QFile::remove(settingsFile);
+	{
+		QSettings pinned(settingsFile, QSettings::IniFormat);
+		pinned.setValue("Journal/Enabled", true);
+		pinned.setValue("Journal/Path", work + "/journal");
+		pinned.setValue("Copy/Verify", false);
+		pinned.setValue("Copy/Xattrs", false);
+		pinned.setValue("Store/Enabled", false);
+		pinned.setValue("Poll/Mode", "never");
+		pinned.setValue("Watch/Backend", "auto");
+		pinned.setValue("Queue/Capacity", 4096);
+	}
+	AutoCopySchedule::setSettingsFile(settingsFile);
+
+	QTextStream err(stderr);
+	QList<BenchTree> trees;
+	trees << makeFlatTree(sources, "small", int(scaled(scale, 2000)), 4 * 1024);
+	trees << makeFlatTree(sources, "huge", int(scaled(scale, 3)), 64 * 1024 * 1024);
+	trees << makeDeepTree(sources, 16, int(scaled(scale, 32)), 1024);
+
+	QList<BenchResult> results;
+	for each (const BenchTree& tree in trees)
+	{
+		if (filter.isEmpty() || QString("copyFileToPath/" + tree.Name).contains(filter))
+			results << benchCopyFileToPath(tree, work);
+		if (filter.isEmpty() || QString("copyFileToPath/" + tree.Name + "/cold+verify").contains(filter))
+			results << benchVerifiedCopy(tree, work);
+		if (tree.Name != "deep"
+			&& (filter.isEmpty() || QString("copyFileToPaths/" + tree.Name).contains(filter)))
+			results << benchFanOut(tree, work, 6);
+	}
+	if (filter.isEmpty() || QString("copyFileToPath/sparse").contains(filter))
+		results << benchSparse(makeSparseTree(sources, int(scaled(scale, 4)), 512 * 1024 * 1024), work);
+	if (filter.isEmpty() || QString("checkCopyFile").contains(filter))
+	{
+		results << benchCheckCopyFile(work, 16, int(scaled(scale, 200000)));
+		results << benchCheckCopyFile(work, 256, int(scaled(scale, 200000)));
+	}
+	if (filter.isEmpty() || QString("BlockingQueue").contains(filter))
+	{
+		results << benchBlockingQueue(1, int(scaled(scale, 200000)));
+		results << benchBlockingQueue(4, int(scaled(scale, 50000)));
+	}
+	if (filter.isEmpty() || QString("GroupQueue").contains(filter))
+		results << benchGroupQueue(4, int(scaled(scale, 50000)));
+	if (filter.isEmpty() || QString("RuleSearch").contains(filter))
+		results << benchRuleSearch(int(scaled(scale, 100000)));
+	// the watcher only sees the top level of a rule directory, the deep
+	// tree is covered by the isolated cases
+	for each (const BenchTree& tree in trees)
+	{
+		if (tree.Name == "deep")
+			continue;
+		if (filter.isEmpty() || QString("pipeline/" + tree.Name).contains(filter))
+			results << benchPipeline(tree, work);
+	}
+
+	QJsonArray array;
+	for each (const BenchResult& result in results)
+	{
+		QJsonObject obj = result.toJson();
+		array.append(obj);
+		err << QString("%1  %2 items/s  %3 MB/s  %4 ns/byte cpu\n")
+			.arg(result.Name, -36)
+			.arg(obj.value("items_per_sec").toDouble(), 12, 'f', 1)
+			.arg(obj.value("mb_per_sec").toDouble(), 9, 'f', 1)
+			.arg(obj.value("cpu_ns_per_byte").toDouble(), 7, 'f', 2);
+	}
+	err.flush();
+
+	QJsonObject doc;
+	doc.insert("benchmark", QString("autocopy"));
+	doc.insert("version", 1);
+	doc.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+	doc.insert("qt", QString(qVersion()));
+	doc.insert("os", QSysInfo::prettyProductName());
+	doc.insert("cpu", QSysInfo::currentCpuArchitecture());
+	doc.insert("threads", QThread::idealThreadCount());
+	doc.insert("scale", scale);
+	doc.insert("results", array);
+	QByteArray json = QJsonDocument(doc).toJson();
+
+	if (parser.isSet(outOption))
+	{
+		QFile out(parser.value(outOption));
+		if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			err << "cannot write " << out.fileName() << "\n";
+			return 1;
+		}
+		out.write(json);
+	}
+	else
+	{
+		QFile out;
+		out.open(stdout, QIODevice::WriteOnly);
+		out.write(json);
+	}
+	return 0;
+}
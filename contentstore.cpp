@@ -0,0 +1,284 @@
+#include "contentstore.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include "copytrace.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// the fingerprint cache is written after this many changes and on exit
+static const int kSaveEvery = 256;
+static const qint64 kHashChunkBytes = 1024 * 1024;
+static const quint32 kCacheMagic = 0x41434650;	// "ACFP"
+static const quint32 kCacheVersion = 1;
+// blobs are shared by every destination linked to them and lose only the
+// write bits, an executable stays executable through its links
+static const QFile::Permissions kWritePermissions = QFile::WriteOwner | QFile::WriteUser
+	| QFile::WriteGroup | QFile::WriteOther;
+
+static void protectBlob(const QString& blob)
+{
+	QFile::setPermissions(blob, QFile::permissions(blob) & ~kWritePermissions);
+}
+
+ContentStore::ContentStore(const QString& rootPath)
+	: m_rootPath(rootPath)
+	, m_unsaved(0)
+{
+	QDir().mkpath(m_rootPath + "/objects");
+	QDir().mkpath(m_rootPath + "/staging");
+	load();
+}
+
+ContentStore::~ContentStore()
+{
+	save();
+}
+
+QString ContentStore::blobPath(const QByteArray& hash) const
+{
+	QByteArray hex = hash.toHex();
+	return QString("%1/objects/%2/%3").arg(m_rootPath)
+		.arg(QString::fromLatin1(hex.left(2)))
+		.arg(QString::fromLatin1(hex.mid(2)));
+}
+
+QString ContentStore::cachePath() const
+{
+	return m_rootPath + "/fingerprints";
+}
+
+void ContentStore::load()
+{
+	QFile file(cachePath());
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+	QDataStream in(&file);
+	quint32 magic = 0, version = 0;
+	in >> magic >> version;
+	if (magic != kCacheMagic || version != kCacheVersion)
+		return;
+	qint32 count = 0;
+	in >> count;
+	for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+	{
+		QString path;
+		Fingerprint fp;
+		in >> path >> fp.Size >> fp.ModifiedMs >> fp.Hash;
+		m_fingerprints.insert(path, fp);
+	}
+}
+
+void ContentStore::save()
+{
+	QMutexLocker locker(&m_lock);
+	if (m_unsaved == 0)
+		return;
+	QString tmpPath = cachePath() + ".tmp";
+	QFile file(tmpPath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return;
+	QDataStream out(&file);
+	out << kCacheMagic << kCacheVersion << qint32(m_fingerprints.size());
+	QHash<QString, Fingerprint>::const_iterator it = m_fingerprints.constBegin();
+	for (; it != m_fingerprints.constEnd(); ++it)
+		out << it.key() << it.value().Size << it.value().ModifiedMs << it.value().Hash;
+	file.close();
+	QFile::remove(cachePath());
+	QFile::rename(tmpPath, cachePath());
+	m_unsaved = 0;
+}
+
+// hashes the file and stages a copy of it, read in one pass
+QByteArray ContentStore::hashAndStage(const QString& filePath, QString& stagedPath)
+{
+	TRACE_SCOPE_ARG("ContentStore::hash", filePath);
+	QFile source(filePath);
+	if (!source.open(QIODevice::ReadOnly))
+		return QByteArray();
+	stagedPath = QString("%1/staging/%2-%3").arg(m_rootPath)
+		.arg(QDateTime::currentMSecsSinceEpoch()).arg(qHash(filePath));
+	QFile staged(stagedPath);
+	if (!staged.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return QByteArray();
+	QCryptographicHash hash(QCryptographicHash::Sha256);
+	while (!source.atEnd())
+	{
+		QByteArray chunk = source.read(kHashChunkBytes);
+		if (chunk.isEmpty() || staged.write(chunk) != chunk.size())
+		{
+			staged.close();
+			QFile::remove(stagedPath);
+			return QByteArray();
+		}
+		hash.addData(chunk);
+	}
+	CTools::copyFileMetadata(source, staged);
+	staged.close();
+	return hash.result();
+}
+
+QByteArray ContentStore::cachedFingerprint(const QString& filePath, const QFileInfo& info)
+{
+	QMutexLocker locker(&m_lock);
+	QHash<QString, Fingerprint>::const_iterator it = m_fingerprints.constFind(filePath);
+	if (it != m_fingerprints.constEnd() && it.value().Size == info.size()
+		&& it.value().ModifiedMs == info.lastModified().toMSecsSinceEpoch())
+		return it.value().Hash;
+	return QByteArray();
+}
+
+void ContentStore::remember(const QString& filePath, const QFileInfo& info, const QByteArray& hash)
+{
+	Fingerprint fp;
+	fp.Size = info.size();
+	fp.ModifiedMs = info.lastModified().toMSecsSinceEpoch();
+	fp.Hash = hash;
+	QMutexLocker locker(&m_lock);
+	m_fingerprints.insert(filePath, fp);
+	++m_unsaved;
+}
+
+bool ContentStore::materialize(const QString& sourceFile, const QString& toDir,
+	QString& errorMsg, CTools::CopyStats* stats)
+{
+	TRACE_SCOPE_ARG("ContentStore::materialize", sourceFile);
+	QFileInfo sourceInfo(sourceFile);
+	if (!sourceInfo.exists())
+	{
+		errorMsg = CTools::copyErrorMsg(CTools::NON_EXISTENT, sourceFile);
+		stats->Error = CTools::NON_EXISTENT;
+		return false;
+	}
+	QString dir = QString(toDir).replace("\\", "/");
+	QString destFile = dir + "/" + sourceInfo.fileName();
+	if (!QDir().mkpath(dir))
+	{
+		errorMsg = CTools::copyErrorMsg(CTools::UNABLE_CREATE, dir);
+		stats->Error = CTools::UNABLE_CREATE;
+		return false;
+	}
+
+	// a cached fingerprint avoids reading the source at all, otherwise it
+	// is hashed and staged in the same pass
+	QByteArray hash = cachedFingerprint(sourceFile, sourceInfo);
+	QString stagedPath;
+	if (hash.isEmpty())
+	{
+		hash = hashAndStage(sourceFile, stagedPath);
+		if (!hash.isEmpty())
+			remember(sourceFile, sourceInfo, hash);
+	}
+	if (hash.isEmpty())
+	{
+		errorMsg = CTools::copyErrorMsg(CTools::COPY_FAILED, sourceFile);
+		stats->Error = CTools::COPY_FAILED;
+		return false;
+	}
+
+	QString blob = blobPath(hash);
+	if (!QFile::exists(blob))
+	{
+		QDir().mkpath(QFileInfo(blob).absolutePath());
+		if (stagedPath.isEmpty())
+			hashAndStage(sourceFile, stagedPath);
+		if (stagedPath.isEmpty() || !QFile::rename(stagedPath, blob))
+		{
+			QFile::remove(stagedPath);
+			errorMsg = CTools::copyErrorMsg(CTools::COPY_FAILED, sourceFile);
+			stats->Error = CTools::COPY_FAILED;
+			return false;
+		}
+		protectBlob(blob);
+		stats->Bytes = sourceInfo.size();
+	}
+	else if (!stagedPath.isEmpty())
+	{
+		QFile::remove(stagedPath);
+	}
+
+	// already a link to the blob, or a copy of it made on another volume
+	QFileInfo destInfo(destFile);
+	QByteArray destHash;
+	if (destInfo.exists())
+	{
+		QByteArray destId = CTools::fileId(destFile);
+		destHash = cachedFingerprint(destFile, destInfo);
+		if ((!destId.isEmpty() && destId == CTools::fileId(blob)) || destHash == hash)
+		{
+			stats->Skipped = true;
+			return true;
+		}
+	}
+
+	// the new link or copy is made next to the destination and renamed over
+	// it, the old destination stays if anything fails
+	QString partPath = destFile + ".part";
+	QFile::remove(partPath);
+	if (!createHardLink(blob, partPath))
+	{
+		// other volume, a real copy that is not shared. it goes through
+		// copyFileToPath for the metadata, Copy/Verify and the atomic replace
+		if (!CTools::copyFileToPath(sourceFile, dir, errorMsg, true, stats))
+			return false;
+		// the source may have changed since it was hashed
+		if (cachedFingerprint(sourceFile, QFileInfo(sourceFile)) == hash)
+			remember(destFile, QFileInfo(destFile), hash);
+		if (m_unsaved >= kSaveEvery)
+			save();
+		return true;
+	}
+	if (!replaceDestination(partPath, destFile, destHash))
+	{
+		QFile::remove(partPath);
+		errorMsg = CTools::copyErrorMsg(CTools::COPY_FAILED, sourceFile);
+		stats->Error = CTools::COPY_FAILED;
+		return false;
+	}
+	remember(destFile, QFileInfo(destFile), hash);
+	if (m_unsaved >= kSaveEvery)
+		save();
+	return true;
+}
+
+bool ContentStore::replaceDestination(const QString& partPath, const QString& destFile,
+	const QByteArray& oldHash)
+{
+#ifdef Q_OS_WIN
+	// MoveFileEx refuses to replace a read-only file, and the read-only
+	// attribute of a linked destination is the one of its blob
+	QFile::Permissions perms = QFile::permissions(destFile);
+	bool readOnly = perms != 0 && !(perms & QFile::WriteOwner);
+	if (readOnly)
+		QFile::setPermissions(destFile, perms | QFile::WriteOwner | QFile::WriteUser);
+	bool replaced = CTools::replaceFile(partPath, destFile);
+	if (readOnly)
+	{
+		if (!replaced)
+			QFile::setPermissions(destFile, perms);
+		else if (!oldHash.isEmpty() && QFile::exists(blobPath(oldHash)))
+			protectBlob(blobPath(oldHash));
+	}
+	return replaced;
+#else
+	Q_UNUSED(oldHash);
+	return CTools::replaceFile(partPath, destFile);
+#endif
+}
+
+bool ContentStore::createHardLink(const QString& target, const QString& link)
+{
+#ifdef Q_OS_WIN
+	return CreateHardLinkW((const wchar_t*)QDir::toNativeSeparators(link).utf16(),
+		(const wchar_t*)QDir::toNativeSeparators(target).utf16(), nullptr) != FALSE;
+#else
+	return ::link(QFile::encodeName(target).constData(), QFile::encodeName(link).constData()) == 0;
+#endif
+}
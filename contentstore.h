@@ -0,0 +1,62 @@
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QByteArray>
+#include "Tools.h"
+
+class QFileInfo;
+
+/// content-addressed store for destinations.
+/// every unique file content is written once under objects/ and the
+/// destinations are hard links to it, so copying the same file into many
+/// trees only costs a link. destinations share one copy on disk, the blobs
+/// lose their write bits so an edit through one destination cannot change
+/// the others; the other bits, exec included, are those of the source. a
+/// destination is replaced by renaming a new link over it. a link is not
+/// verified, Copy/Verify does not apply to it.
+/// when the destination is on another volume the source is copied by
+/// CTools::copyFileToPath instead, with its metadata and Copy/Verify, the
+/// fingerprint of the copy tells later events that it is up to date.
+class ContentStore
+{
+public:
+	explicit ContentStore(const QString& rootPath);
+	~ContentStore();
+
+	// makes toDir/<file name> hold the content of sourceFile, same
+	// contract as CTools::copyFileToPath
+	bool materialize(const QString& sourceFile, const QString& toDir,
+		QString& errorMsg, CTools::CopyStats* stats);
+	void save();
+
+private:
+	struct Fingerprint
+	{
+		qint64 Size;
+		qint64 ModifiedMs;
+		QByteArray Hash;
+	};
+	// content hash cached by path, size and modification time
+	QByteArray cachedFingerprint(const QString& filePath, const QFileInfo& info);
+	void remember(const QString& filePath, const QFileInfo& info, const QByteArray& hash);
+	QByteArray hashAndStage(const QString& filePath, QString& stagedPath);
+	QString blobPath(const QByteArray& hash) const;
+	// renames partPath over destFile. oldHash is the content of destFile,
+	// its blob is made read-only again where the rename needed it writable
+	bool replaceDestination(const QString& partPath, const QString& destFile,
+		const QByteArray& oldHash);
+	QString cachePath() const;
+	void load();
+
+	static bool createHardLink(const QString& target, const QString& link);
+
+	QString m_rootPath;
+	QMutex m_lock;
+	QHash<QString, Fingerprint> m_fingerprints;
+	int m_unsaved;
+};
+
+#endif // CONTENTSTORE_H
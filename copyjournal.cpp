@@ -0,0 +1,131 @@
+#include "copyjournal.h"
+#include <QDir>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+// flush when this many records are pending, or after the interval
+static const int kJournalBatch = 512;
+static const unsigned long kJournalFlushMs = 1000;
+
+static const char* resultName(int result)
+{
+	switch (result)
+	{
+	case CopyJournalRecord::COPIED:
+		return "copied";
+	case CopyJournalRecord::SKIPPED:
+		return "skipped";
+	case CopyJournalRecord::DELETED:
+		return "deleted";
+	case CopyJournalRecord::RENAMED:
+		return "renamed";
+	default:
+		return "failed";
+	}
+}
+
+CopyJournal::CopyJournal(const QString& dirPath, qint64 maxBytes, int maxFiles)
+	: m_dirPath(dirPath)
+	, m_maxBytes(maxBytes)
+	, m_maxFiles(qMax(maxFiles, 1))
+	, m_stop(false)
+{
+	this->start(QThread::LowPriority);
+}
+
+CopyJournal::~CopyJournal()
+{
+	stop();
+}
+
+void CopyJournal::record(const CopyJournalRecord& rec)
+{
+	QMutexLocker locker(&m_lock);
+	m_pending << rec;
+	if (m_pending.size() >= kJournalBatch)
+		m_wake.wakeOne();
+}
+
+void CopyJournal::stop()
+{
+	{
+		QMutexLocker locker(&m_lock);
+		m_stop = true;
+		m_wake.wakeOne();
+	}
+	wait();
+}
+
+QString CopyJournal::filePath() const
+{
+	return m_dirPath + "/journal.jsonl";
+}
+
+void CopyJournal::run()
+{
+	QVector<CopyJournalRecord> batch;
+	bool stopping = false;
+	while (!stopping)
+	{
+		{
+			QMutexLocker locker(&m_lock);
+			if (!m_stop && m_pending.size() < kJournalBatch)
+				m_wake.wait(&m_lock, kJournalFlushMs);
+			batch.swap(m_pending);
+			stopping = m_stop;
+		}
+		if (!batch.isEmpty())
+		{
+			writeBatch(batch);
+			batch.clear();
+		}
+	}
+	m_file.close();
+}
+
+void CopyJournal::writeBatch(const QVector<CopyJournalRecord>& batch)
+{
+	if (!m_file.isOpen() && !openFile())
+		return;
+
+	QByteArray lines;
+	for (int i = 0; i < batch.size(); ++i)
+	{
+		const CopyJournalRecord& rec = batch.at(i);
+		QJsonObject obj;
+		obj.insert("ts", double(rec.Time));
+		obj.insert("rule", rec.Rule);
+		obj.insert("src", rec.Source);
+		obj.insert("dest", rec.Dest);
+		obj.insert("bytes", double(rec.Bytes));
+		obj.insert("us", double(rec.DurationUs));
+		obj.insert("result", QString(resultName(rec.Result)));
+		if (rec.ErrorCode >= 0)
+			obj.insert("error", rec.ErrorCode);
+		lines += QJsonDocument(obj).toJson(QJsonDocument::Compact);
+		lines += '\n';
+	}
+	m_file.write(lines);
+	m_file.flush();
+
+	if (m_file.size() >= m_maxBytes)
+		rotate();
+}
+
+bool CopyJournal::openFile()
+{
+	QDir().mkpath(m_dirPath);
+	m_file.setFileName(filePath());
+	return m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void CopyJournal::rotate()
+{
+	m_file.close();
+	QString base = m_dirPath + "/journal.%1.jsonl";
+	QFile::remove(base.arg(m_maxFiles));
+	for (int i = m_maxFiles - 1; i >= 1; --i)
+		QFile::rename(base.arg(i), base.arg(i + 1));
+	QFile::rename(filePath(), base.arg(1));
+	openFile();
+}
@@ -0,0 +1,67 @@
+#ifndef COPYJOURNAL_H
+#define COPYJOURNAL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QFile>
+
+/// outcome of one source -> destination copy
+struct CopyJournalRecord
+{
+	enum Result
+	{
+		COPIED,
+		SKIPPED,	// destination already up to date
+		FAILED,
+		DELETED,	// mirror rule, source was deleted
+		RENAMED		// mirror rule, destination renamed along with the source
+	};
+	qint64 Time;		// msecs since epoch
+	QString Rule;		// rule source key
+	QString Source;
+	QString Dest;
+	qint64 Bytes;
+	qint64 DurationUs;
+	int Result;
+	int ErrorCode;		// CTools::emCopyError, -1 if none
+
+	CopyJournalRecord() : Time(0), Bytes(0), DurationUs(0), Result(COPIED), ErrorCode(-1) {}
+};
+
+/// append-only JSON-lines journal of copy outcomes.
+/// record() only appends to an in-memory batch, a background thread writes
+/// the batches and rotates journal.jsonl -> journal.1.jsonl ... when the
+/// file grows past maxBytes.
+class CopyJournal : public QThread
+{
+	Q_OBJECT
+public:
+	CopyJournal(const QString& dirPath, qint64 maxBytes = 16 * 1024 * 1024, int maxFiles = 5);
+	~CopyJournal();
+
+	void record(const CopyJournalRecord& rec);
+	void stop();
+	QString filePath() const;
+
+protected:
+	void run();
+
+private:
+	void writeBatch(const QVector<CopyJournalRecord>& batch);
+	bool openFile();
+	void rotate();
+
+	QString m_dirPath;
+	qint64 m_maxBytes;
+	int m_maxFiles;
+	QFile m_file;
+
+	QMutex m_lock;
+	QWaitCondition m_wake;
+	QVector<CopyJournalRecord> m_pending;
+	bool m_stop;
+};
+
+#endif // COPYJOURNAL_H
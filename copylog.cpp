@@ -0,0 +1,27 @@
+#include "copylog.h"
+#include <QDateTime>
+
+CopyLog::CopyLog(int capacity)
+	: m_ring(capacity)
+	, m_dropped(0)
+{
+}
+
+void CopyLog::post(int level, const QString& text, const QString& dest)
+{
+	CopyLogEntry entry;
+	entry.Time = QDateTime::currentMSecsSinceEpoch();
+	entry.Level = level;
+	entry.Text = text;
+	entry.Dest = dest;
+	if (!m_ring.push(entry))
+		m_dropped.fetchAndAddRelaxed(1);
+}
+
+int CopyLog::drain(CopyLogEntryList& entries, int maxEntries)
+{
+	CopyLogEntry entry;
+	while (entries.size() < maxEntries && m_ring.pop(entry))
+		entries << entry;
+	return m_dropped.fetchAndStoreRelaxed(0);
+}
@@ -0,0 +1,46 @@
+#ifndef COPYLOG_H
+#define COPYLOG_H
+
+#include <QString>
+#include <QList>
+#include <QAtomicInt>
+#include "RingBuffer.h"
+
+/// one line of the Output pane
+struct CopyLogEntry
+{
+	enum LogLevel
+	{
+		LOG_MESSAGE,
+		LOG_COPY,
+		LOG_ERROR
+	};
+	qint64 Time;	// msecs since epoch
+	int Level;		// LogLevel
+	QString Text;
+	QString Dest;	// destination of LOG_COPY, used to summarize bursts
+
+	CopyLogEntry() : Time(0), Level(LOG_MESSAGE) {}
+};
+typedef QList<CopyLogEntry> CopyLogEntryList;
+
+/// log pipeline between the copy thread and the Output pane.
+/// producers post into a lock-free ring and never block: when the ring is
+/// full the entry is counted as dropped. the GUI drains it at a fixed rate.
+class CopyLog
+{
+public:
+	explicit CopyLog(int capacity = 16384);
+
+	void post(int level, const QString& text, const QString& dest = QString());
+	// take up to maxEntries entries, returns the number of entries dropped
+	// since the last call
+	int drain(CopyLogEntryList& entries, int maxEntries);
+	bool isEmpty() const { return m_ring.size() <= 0; }
+
+private:
+	RingBuffer<CopyLogEntry> m_ring;
+	QAtomicInt m_dropped;
+};
+
+#endif // COPYLOG_H
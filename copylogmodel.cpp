@@ -0,0 +1,226 @@
+#include "copylogmodel.h"
+#include <QDateTime>
+#include <QBrush>
+#include <QRegularExpression>
+#include <algorithm>
+
+static const int kChunkLines = 4096;
+static const int kTrigramBits = 1 << 16;
+
+CopyLogStore::CopyLogStore(int maxLines)
+	: m_first(0)
+	, m_size(0)
+	, m_maxLines(qMax(maxLines, kChunkLines))
+{
+}
+
+CopyLogStore::~CopyLogStore()
+{
+	qDeleteAll(m_chunks);
+}
+
+const CopyLogEntry& CopyLogStore::at(int row) const
+{
+	return m_chunks.at(row / kChunkLines)->Lines.at(row % kChunkLines);
+}
+
+int CopyLogStore::rowsToEvict(int count) const
+{
+	int overflow = m_size + count - m_maxLines;
+	if (overflow <= 0)
+		return 0;
+	// whole chunks only, rows keep their chunk/offset mapping
+	int rows = ((overflow + kChunkLines - 1) / kChunkLines) * kChunkLines;
+	return qMin(rows, m_size);
+}
+
+void CopyLogStore::evictFront(int rows)
+{
+	if (rows >= m_size)
+	{
+		clear();
+		return;
+	}
+	int chunks = rows / kChunkLines;
+	for (int i = 0; i < chunks; ++i)
+		delete m_chunks.takeFirst();
+	m_first += chunks * kChunkLines;
+	m_size -= chunks * kChunkLines;
+	m_errors.erase(m_errors.begin(),
+		std::lower_bound(m_errors.begin(), m_errors.end(), m_first));
+}
+
+void CopyLogStore::append(const CopyLogEntry& entry)
+{
+	if (m_chunks.isEmpty() || m_chunks.last()->Lines.size() == kChunkLines)
+	{
+		Chunk* chunk = new Chunk;
+		chunk->Lines.reserve(kChunkLines);
+		chunk->Trigrams.resize(kTrigramBits);
+		m_chunks << chunk;
+	}
+	Chunk* chunk = m_chunks.last();
+	CopyLogEntry line = entry;
+	line.Dest.clear();
+	if (line.Text.contains('\n'))
+		line.Text.replace(QRegularExpression("\\s*\\n\\s*"), "  ");
+
+	QVector<int> hashes;
+	trigramHashes(line.Text.toLower(), hashes);
+	for (int i = 0; i < hashes.size(); ++i)
+		chunk->Trigrams.setBit(hashes.at(i));
+
+	if (line.Level == CopyLogEntry::LOG_ERROR)
+		m_errors << m_first + m_size;
+	chunk->Lines << line;
+	++m_size;
+}
+
+void CopyLogStore::clear()
+{
+	qDeleteAll(m_chunks);
+	m_chunks.clear();
+	m_errors.clear();
+	m_first += m_size;
+	m_size = 0;
+}
+
+int CopyLogStore::nextError(int fromRow) const
+{
+	QVector<qint64>::const_iterator it =
+		std::upper_bound(m_errors.begin(), m_errors.end(), m_first + fromRow);
+	if (it == m_errors.end())
+		return -1;
+	return int(*it - m_first);
+}
+
+int CopyLogStore::find(const QString& text, int fromRow, bool forward) const
+{
+	if (text.isEmpty() || m_size == 0)
+		return -1;
+	QVector<int> hashes;
+	trigramHashes(text.toLower(), hashes);
+
+	int row = forward ? qMax(fromRow + 1, 0) : qMin(fromRow - 1, m_size - 1);
+	while (row >= 0 && row < m_size)
+	{
+		const int ci = row / kChunkLines;
+		const Chunk* chunk = m_chunks.at(ci);
+		if (!chunkMayContain(chunk, hashes))
+		{// skip the whole chunk
+			row = forward ? (ci + 1) * kChunkLines : ci * kChunkLines - 1;
+			continue;
+		}
+		const int begin = ci * kChunkLines;
+		const int end = begin + chunk->Lines.size();
+		for (; row >= begin && row < end; row += forward ? 1 : -1)
+		{
+			if (chunk->Lines.at(row - begin).Text.contains(text, Qt::CaseInsensitive))
+				return row;
+		}
+	}
+	return -1;
+}
+
+void CopyLogStore::trigramHashes(const QString& lowerText, QVector<int>& hashes)
+{
+	const int n = lowerText.size();
+	if (n < 3)
+		return;
+	hashes.reserve(n - 2);
+	const QChar* s = lowerText.constData();
+	for (int i = 0; i + 2 < n; ++i)
+	{
+		quint32 h = s[i].unicode() * 0x9E3779B1u
+			^ s[i + 1].unicode() * 0x85EBCA6Bu
+			^ s[i + 2].unicode() * 0xC2B2AE35u;
+		hashes << int((h ^ (h >> 16)) & (kTrigramBits - 1));
+	}
+}
+
+bool CopyLogStore::chunkMayContain(const Chunk* chunk, const QVector<int>& hashes) const
+{
+	for (int i = 0; i < hashes.size(); ++i)
+	{
+		if (!chunk->Trigrams.testBit(hashes.at(i)))
+			return false;
+	}
+	return true;
+}
+
+CopyLogModel::CopyLogModel(QObject* parent, int maxLines)
+	: QAbstractListModel(parent)
+	, m_store(maxLines)
+{
+}
+
+int CopyLogModel::rowCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : m_store.size();
+}
+
+QVariant CopyLogModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || index.row() >= m_store.size())
+		return QVariant();
+	const CopyLogEntry& entry = m_store.at(index.row());
+	switch (role)
+	{
+	case Qt::DisplayRole:
+		return QDateTime::fromMSecsSinceEpoch(entry.Time).time().toString()
+			+ " " + entry.Text;
+	case Qt::ForegroundRole:
+		if (entry.Level == CopyLogEntry::LOG_ERROR)
+			return QBrush(Qt::red);
+		break;
+	default:
+		break;
+	}
+	return QVariant();
+}
+
+void CopyLogModel::appendEntries(const CopyLogEntryList& entries)
+{
+	if (entries.isEmpty())
+		return;
+	int skip = qMax(0, entries.size() - m_store.maxLines());
+	int count = entries.size() - skip;
+
+	int evict = m_store.rowsToEvict(count);
+	if (evict > 0)
+	{
+		beginRemoveRows(QModelIndex(), 0, evict - 1);
+		m_store.evictFront(evict);
+		endRemoveRows();
+	}
+
+	beginInsertRows(QModelIndex(), m_store.size(), m_store.size() + count - 1);
+	for (int i = skip; i < entries.size(); ++i)
+		m_store.append(entries.at(i));
+	endInsertRows();
+}
+
+void CopyLogModel::clear()
+{
+	beginResetModel();
+	m_store.clear();
+	endResetModel();
+}
+
+int CopyLogModel::findNext(const QString& text, int fromRow, bool forward) const
+{
+	int row = m_store.find(text, fromRow, forward);
+	if (row < 0)
+	{// wrap around
+		row = m_store.find(text, forward ? -1 : m_store.size(), forward);
+	}
+	return row;
+}
+
+int CopyLogModel::nextError(int fromRow) const
+{
+	int row = m_store.nextError(fromRow);
+	if (row < 0)
+		row = m_store.nextError(-1);
+	return row;
+}
@@ -0,0 +1,73 @@
+#ifndef COPYLOGMODEL_H
+#define COPYLOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QBitArray>
+#include <QVector>
+#include <QList>
+#include "copylog.h"
+
+/// in-memory structured log behind the Output pane.
+/// lines are kept in fixed size chunks; the oldest chunk is dropped when
+/// the line limit is reached. error lines are indexed by sequence number
+/// and every chunk keeps a trigram bitmap, so search only scans chunks
+/// that can contain the text.
+class CopyLogStore
+{
+public:
+	explicit CopyLogStore(int maxLines);
+	~CopyLogStore();
+
+	int size() const { return m_size; }
+	int maxLines() const { return m_maxLines; }
+	const CopyLogEntry& at(int row) const;
+
+	// rows that must be dropped from the front before appending count lines
+	int rowsToEvict(int count) const;
+	void evictFront(int rows);
+	void append(const CopyLogEntry& entry);
+	void clear();
+
+	// first error row after fromRow, -1 if none
+	int nextError(int fromRow) const;
+	// first row after (or before) fromRow containing text, -1 if none
+	int find(const QString& text, int fromRow, bool forward) const;
+
+private:
+	struct Chunk
+	{
+		QVector<CopyLogEntry> Lines;
+		QBitArray Trigrams;
+	};
+	static void trigramHashes(const QString& lowerText, QVector<int>& hashes);
+	bool chunkMayContain(const Chunk* chunk, const QVector<int>& hashes) const;
+
+	QList<Chunk*> m_chunks;
+	QVector<qint64> m_errors;	// sequence numbers of error lines, ascending
+	qint64 m_first;				// sequence number of row 0
+	int m_size;
+	int m_maxLines;
+};
+
+/// Qt model over CopyLogStore, only visible rows are ever formatted
+class CopyLogModel : public QAbstractListModel
+{
+	Q_OBJECT
+public:
+	CopyLogModel(QObject* parent, int maxLines);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const Q_DECL_OVERRIDE;
+	QVariant data(const QModelIndex& index, int role) const Q_DECL_OVERRIDE;
+
+	void appendEntries(const CopyLogEntryList& entries);
+	void clear();
+
+	// both wrap around, -1 if nothing matches
+	int findNext(const QString& text, int fromRow, bool forward) const;
+	int nextError(int fromRow) const;
+
+private:
+	CopyLogStore m_store;
+};
+
+#endif // COPYLOGMODEL_H
@@ -0,0 +1,235 @@
+#include "copymetrics.h"
+#include <QDateTime>
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram()
+	: Count(0)
+	, SumUs(0)
+{
+	memset(Counts, 0, sizeof(Counts));
+}
+
+void LatencyHistogram::add(qint64 us)
+{
+	if (us < 0)
+		us = 0;
+	int bucket = 0;
+	while (bucket < BUCKETS - 1 && (qint64(1) << bucket) <= us)
+		++bucket;
+	++Counts[bucket];
+	++Count;
+	SumUs += quint64(us);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+	for (int i = 0; i < BUCKETS; ++i)
+		Counts[i] += other.Counts[i];
+	Count += other.Count;
+	SumUs += other.SumUs;
+}
+
+qint64 LatencyHistogram::quantileUs(double q) const
+{
+	if (Count == 0)
+		return 0;
+	quint64 rank = quint64(q * Count);
+	quint64 seen = 0;
+	for (int i = 0; i < BUCKETS; ++i)
+	{
+		seen += Counts[i];
+		if (seen > rank)
+			return qint64(1) << i;
+	}
+	return qint64(1) << (BUCKETS - 1);
+}
+
+void RuleCounters::merge(const RuleCounters& other)
+{
+	Files += other.Files;
+	Bytes += other.Bytes;
+	Skipped += other.Skipped;
+	Failures += other.Failures;
+	CopyLatency.merge(other.CopyLatency);
+}
+
+CopyMetrics::CopyMetrics()
+{
+}
+
+CopyMetrics::Shard* CopyMetrics::localShard()
+{
+	if (!m_local.hasLocalData())
+	{
+		QSharedPointer<Shard> shard(new Shard);
+		m_local.setLocalData(shard);
+		QMutexLocker locker(&m_shardsLock);
+		m_shards << shard;
+	}
+	return m_local.localData().data();
+}
+
+void CopyMetrics::recordCopy(const QString& rule, qint64 bytes, qint64 copyUs, int result)
+{
+	Shard* shard = localShard();
+	QMutexLocker locker(&shard->Lock);
+	RuleCounters& counters = shard->Rules[rule];
+	switch (result)
+	{
+	case COPIED:
+		++counters.Files;
+		counters.Bytes += quint64(bytes);
+		counters.CopyLatency.add(copyUs);
+		break;
+	case SKIPPED:
+		++counters.Skipped;
+		break;
+	default:
+		++counters.Failures;
+		break;
+	}
+}
+
+void CopyMetrics::recordQueueLatency(qint64 us)
+{
+	Shard* shard = localShard();
+	QMutexLocker locker(&shard->Lock);
+	shard->QueueLatency.add(us);
+}
+
+void CopyMetrics::recordEventLatency(qint64 us)
+{
+	Shard* shard = localShard();
+	QMutexLocker locker(&shard->Lock);
+	shard->EventLatency.add(us);
+}
+
+void CopyMetrics::increment(const char* counter, quint64 n)
+{
+	Shard* shard = localShard();
+	QMutexLocker locker(&shard->Lock);
+	shard->Counters[counter] += n;
+}
+
+CopyMetrics::Snapshot CopyMetrics::snapshot() const
+{
+	Snapshot snap;
+	snap.TakenAtMs = QDateTime::currentMSecsSinceEpoch();
+	QList<QSharedPointer<Shard> > shards;
+	{
+		QMutexLocker locker(&m_shardsLock);
+		shards = m_shards;
+	}
+	for (int i = 0; i < shards.size(); ++i)
+	{
+		Shard* shard = shards.at(i).data();
+		QMutexLocker locker(&shard->Lock);
+		QHash<QString, RuleCounters>::const_iterator it = shard->Rules.constBegin();
+		for (; it != shard->Rules.constEnd(); ++it)
+		{
+			snap.Rules[it.key()].merge(it.value());
+			snap.Total.merge(it.value());
+		}
+		snap.QueueLatency.merge(shard->QueueLatency);
+		snap.EventLatency.merge(shard->EventLatency);
+		QHash<const char*, quint64>::const_iterator c = shard->Counters.constBegin();
+		for (; c != shard->Counters.constEnd(); ++c)
+			snap.Counters[QString::fromLatin1(c.key())] += c.value();
+	}
+	return snap;
+}
+
+void CopyMetrics::reset()
+{
+	QMutexLocker locker(&m_shardsLock);
+	for (int i = 0; i < m_shards.size(); ++i)
+	{
+		Shard* shard = m_shards.at(i).data();
+		QMutexLocker shardLocker(&shard->Lock);
+		shard->Rules.clear();
+		shard->QueueLatency = LatencyHistogram();
+		shard->EventLatency = LatencyHistogram();
+		shard->Counters.clear();
+	}
+}
+
+static QByteArray promLabel(const QString& value)
+{
+	QString v = value;
+	v.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+	return v.toUtf8();
+}
+
+static void promHistogram(QByteArray& out, const char* name, const QByteArray& labels,
+	const LatencyHistogram& h)
+{
+	quint64 cumulative = 0;
+	for (int i = 0; i < LatencyHistogram::BUCKETS; ++i)
+	{
+		cumulative += h.Counts[i];
+		out += QByteArray(name) + "_bucket{" + labels + (labels.isEmpty() ? "" : ",")
+			+ "le=\"" + QByteArray::number(double(qint64(1) << i) / 1e6, 'g', 10) + "\"} "
+			+ QByteArray::number(cumulative) + "\n";
+	}
+	out += QByteArray(name) + "_bucket{" + labels + (labels.isEmpty() ? "" : ",")
+		+ "le=\"+Inf\"} " + QByteArray::number(h.Count) + "\n";
+	QByteArray braces = labels.isEmpty() ? QByteArray() : "{" + labels + "}";
+	out += QByteArray(name) + "_sum" + braces + " "
+		+ QByteArray::number(double(h.SumUs) / 1e6, 'g', 12) + "\n";
+	out += QByteArray(name) + "_count" + braces + " " + QByteArray::number(h.Count) + "\n";
+}
+
+QByteArray CopyMetrics::toPrometheus(const Snapshot& snap)
+{
+	QByteArray out;
+	out += "# HELP autocopy_files_total Files copied per rule.\n"
+		"# TYPE autocopy_files_total counter\n";
+	QMap<QString, RuleCounters>::const_iterator it;
+	for (it = snap.Rules.constBegin(); it != snap.Rules.constEnd(); ++it)
+		out += "autocopy_files_total{rule=\"" + promLabel(it.key()) + "\"} "
+			+ QByteArray::number(it.value().Files) + "\n";
+
+	out += "# HELP autocopy_bytes_total Bytes copied per rule.\n"
+		"# TYPE autocopy_bytes_total counter\n";
+	for (it = snap.Rules.constBegin(); it != snap.Rules.constEnd(); ++it)
+		out += "autocopy_bytes_total{rule=\"" + promLabel(it.key()) + "\"} "
+			+ QByteArray::number(it.value().Bytes) + "\n";
+
+	out += "# HELP autocopy_skipped_total Up to date destinations per rule.\n"
+		"# TYPE autocopy_skipped_total counter\n";
+	for (it = snap.Rules.constBegin(); it != snap.Rules.constEnd(); ++it)
+		out += "autocopy_skipped_total{rule=\"" + promLabel(it.key()) + "\"} "
+			+ QByteArray::number(it.value().Skipped) + "\n";
+
+	out += "# HELP autocopy_failures_total Failed copies per rule.\n"
+		"# TYPE autocopy_failures_total counter\n";
+	for (it = snap.Rules.constBegin(); it != snap.Rules.constEnd(); ++it)
+		out += "autocopy_failures_total{rule=\"" + promLabel(it.key()) + "\"} "
+			+ QByteArray::number(it.value().Failures) + "\n";
+
+	out += "# HELP autocopy_copy_duration_seconds Time spent copying one file.\n"
+		"# TYPE autocopy_copy_duration_seconds histogram\n";
+	for (it = snap.Rules.constBegin(); it != snap.Rules.constEnd(); ++it)
+		promHistogram(out, "autocopy_copy_duration_seconds",
+			"rule=\"" + promLabel(it.key()) + "\"", it.value().CopyLatency);
+
+	out += "# HELP autocopy_queue_latency_seconds Time from change event to copy start.\n"
+		"# TYPE autocopy_queue_latency_seconds histogram\n";
+	promHistogram(out, "autocopy_queue_latency_seconds", QByteArray(), snap.QueueLatency);
+
+	out += "# HELP autocopy_event_latency_seconds Time from change event to copy done.\n"
+		"# TYPE autocopy_event_latency_seconds histogram\n";
+	promHistogram(out, "autocopy_event_latency_seconds", QByteArray(), snap.EventLatency);
+
+	out += "# HELP autocopy_queue_depth Tasks waiting in the copy queue.\n"
+		"# TYPE autocopy_queue_depth gauge\n"
+		"autocopy_queue_depth " + QByteArray::number(snap.QueueDepth) + "\n";
+
+	QMap<QString, quint64>::const_iterator c;
+	for (c = snap.Counters.constBegin(); c != snap.Counters.constEnd(); ++c)
+	{
+		QByteArray name = "autocopy_" + c.key().toLatin1() + "_total";
+		out += "# TYPE " + name + " counter\n" + name + " " + QByteArray::number(c.value()) + "\n";
+	}
+	return out;
+}
@@ -0,0 +1,90 @@
+#ifndef COPYMETRICS_H
+#define COPYMETRICS_H
+
+#include <QString>
+#include <QHash>
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QThreadStorage>
+#include <QSharedPointer>
+
+/// latency histogram, bucket i counts values below 2^i microseconds
+struct LatencyHistogram
+{
+	enum { BUCKETS = 32 };
+	quint64 Counts[BUCKETS];
+	quint64 Count;
+	quint64 SumUs;
+
+	LatencyHistogram();
+	void add(qint64 us);
+	void merge(const LatencyHistogram& other);
+	// upper bound of the bucket holding the given quantile, in microseconds
+	qint64 quantileUs(double q) const;
+};
+
+/// counters of one rule
+struct RuleCounters
+{
+	quint64 Files;
+	quint64 Bytes;
+	quint64 Skipped;
+	quint64 Failures;
+	LatencyHistogram CopyLatency;	// duration of copyFileToPath
+
+	RuleCounters() : Files(0), Bytes(0), Skipped(0), Failures(0) {}
+	void merge(const RuleCounters& other);
+};
+
+/// copy counters and latency histograms.
+/// every thread writes into its own shard, shards are only merged when a
+/// snapshot is taken, so recording never contends across threads.
+class CopyMetrics
+{
+public:
+	enum CopyResult { COPIED, SKIPPED, FAILED };
+
+	struct Snapshot
+	{
+		qint64 TakenAtMs;
+		QMap<QString, RuleCounters> Rules;
+		RuleCounters Total;
+		LatencyHistogram QueueLatency;		// event -> copy start
+		LatencyHistogram EventLatency;		// event -> all destinations done
+		QMap<QString, quint64> Counters;	// events, overflows, retries...
+		int QueueDepth;
+		Snapshot() : TakenAtMs(0), QueueDepth(0) {}
+	};
+
+	CopyMetrics();
+
+	void recordCopy(const QString& rule, qint64 bytes, qint64 copyUs, int result);
+	void recordQueueLatency(qint64 us);
+	void recordEventLatency(qint64 us);
+	void increment(const char* counter, quint64 n = 1);
+
+	Snapshot snapshot() const;
+	void reset();
+
+	// Prometheus text exposition format
+	static QByteArray toPrometheus(const Snapshot& snap);
+
+private:
+	struct Shard
+	{
+		QMutex Lock;	// only contended while a snapshot is taken
+		QHash<QString, RuleCounters> Rules;
+		LatencyHistogram QueueLatency;
+		LatencyHistogram EventLatency;
+		QHash<const char*, quint64> Counters;	// keyed by literal
+	};
+	Shard* localShard();
+
+	// the list keeps shards of finished threads alive
+	QThreadStorage<QSharedPointer<Shard> > m_local;
+	mutable QMutex m_shardsLock;
+	QList<QSharedPointer<Shard> > m_shards;
+};
+
+#endif // COPYMETRICS_H
@@ -0,0 +1,170 @@
+#include "copytrace.h"
+#include <QThread>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QSet>
+
+// spans kept per thread
+static const int kTraceBufferEvents = 65536;
+
+QAtomicInt CopyTrace::s_enabled(0);
+
+// created during static initialization, before any thread can trace
+static CopyTrace* s_trace = CopyTrace::instance();
+
+CopyTrace* CopyTrace::instance()
+{
+	static CopyTrace* trace = nullptr;
+	if (!trace)
+		trace = new CopyTrace;
+	return trace;
+}
+
+CopyTrace::CopyTrace()
+	: m_epochMs(QDateTime::currentMSecsSinceEpoch())
+	, m_nextThreadId(1)
+{
+	m_clock.start();
+}
+
+void CopyTrace::setEnabled(bool enable)
+{
+	s_enabled.store(enable ? 1 : 0);
+}
+
+CopyTrace::Lease::~Lease()
+{
+	CopyTrace* trace = CopyTrace::instance();
+	QMutexLocker locker(&trace->m_buffersLock);
+	trace->m_freeBuffers << Ring;
+}
+
+CopyTrace::Buffer* CopyTrace::localBuffer()
+{
+	if (!m_local.hasLocalData())
+	{
+		QString name = QThread::currentThread()->objectName();
+		QMutexLocker locker(&m_buffersLock);
+		QSharedPointer<Buffer> buffer;
+		if (!m_freeBuffers.isEmpty())
+		{
+			// the spans of the finished thread stay, under its thread id
+			buffer = m_freeBuffers.takeLast();
+		}
+		else
+		{
+			buffer = QSharedPointer<Buffer>(new Buffer);
+			buffer->Events.resize(kTraceBufferEvents);
+			buffer->Next = 0;
+			buffer->Wrapped = false;
+			m_buffers << buffer;
+		}
+		int threadId = m_nextThreadId++;
+		m_threadNames.insert(threadId, name.isEmpty() ? QString("thread %1").arg(threadId) : name);
+		{
+			QMutexLocker bufferLocker(&buffer->Lock);
+			buffer->ThreadId = threadId;
+		}
+		Lease* lease = new Lease;
+		lease->Ring = buffer;
+		m_local.setLocalData(lease);
+	}
+	return m_local.localData()->Ring.data();
+}
+
+void CopyTrace::record(const char* name, qint64 startUs, qint64 durationUs, const QString& arg)
+{
+	Buffer* buffer = localBuffer();
+	QMutexLocker locker(&buffer->Lock);
+	TraceEvent& ev = buffer->Events[buffer->Next];
+	ev.Name = name;
+	ev.StartUs = startUs;
+	ev.DurationUs = durationUs;
+	ev.Arg = arg;
+	ev.ThreadId = buffer->ThreadId;
+	if (++buffer->Next == buffer->Events.size())
+	{
+		buffer->Next = 0;
+		buffer->Wrapped = true;
+	}
+}
+
+void CopyTrace::clear()
+{
+	QMutexLocker locker(&m_buffersLock);
+	// only the threads that own a ring can record again
+	QHash<int, QString> names;
+	for (int i = 0; i < m_buffers.size(); ++i)
+	{
+		Buffer* buffer = m_buffers.at(i).data();
+		QMutexLocker bufferLocker(&buffer->Lock);
+		buffer->Next = 0;
+		buffer->Wrapped = false;
+		names.insert(buffer->ThreadId, m_threadNames.value(buffer->ThreadId));
+	}
+	m_threadNames = names;
+}
+
+QByteArray CopyTrace::toChromeJson(qint64 fromUs, qint64 toUs) const
+{
+	QList<QSharedPointer<Buffer> > buffers;
+	QHash<int, QString> threadNames;
+	{
+		QMutexLocker locker(&m_buffersLock);
+		buffers = m_buffers;
+		threadNames = m_threadNames;
+	}
+	QJsonArray events;
+	QSet<int> named;
+	for (int i = 0; i < buffers.size(); ++i)
+	{
+		Buffer* buffer = buffers.at(i).data();
+		QMutexLocker locker(&buffer->Lock);
+		int count = buffer->Wrapped ? buffer->Events.size() : buffer->Next;
+		int first = buffer->Wrapped ? buffer->Next : 0;
+		for (int n = 0; n < count; ++n)
+		{
+			const TraceEvent& ev = buffer->Events.at((first + n) % buffer->Events.size());
+			if (ev.StartUs + ev.DurationUs < fromUs || ev.StartUs > toUs)
+				continue;
+			QJsonObject obj;
+			obj.insert("name", QString(ev.Name));
+			obj.insert("cat", QString("autocopy"));
+			obj.insert("ph", QString("X"));
+			obj.insert("ts", double(ev.StartUs));
+			obj.insert("dur", double(ev.DurationUs));
+			obj.insert("pid", 1);
+			obj.insert("tid", ev.ThreadId);
+			named.insert(ev.ThreadId);
+			if (!ev.Arg.isEmpty())
+			{
+				QJsonObject args;
+				args.insert("path", ev.Arg);
+				obj.insert("args", args);
+			}
+			events.append(obj);
+		}
+	}
+	// names of the threads whose spans are in the dump
+	for (QSet<int>::const_iterator it = named.begin(); it != named.end(); ++it)
+	{
+		QJsonObject meta;
+		meta.insert("name", QString("thread_name"));
+		meta.insert("ph", QString("M"));
+		meta.insert("pid", 1);
+		meta.insert("tid", *it);
+		QJsonObject metaArgs;
+		metaArgs.insert("name", threadNames.value(*it));
+		meta.insert("args", metaArgs);
+		events.append(meta);
+	}
+	QJsonObject doc;
+	doc.insert("traceEvents", events);
+	doc.insert("displayTimeUnit", QString("ms"));
+	QJsonObject other;
+	other.insert("epoch_ms", double(m_epochMs));
+	doc.insert("otherData", other);
+	return QJsonDocument(doc).toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,119 @@
+#ifndef COPYTRACE_H
+#define COPYTRACE_H
+
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QThreadStorage>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+
+/// one finished span
+struct TraceEvent
+{
+	const char* Name;	// literal
+	qint64 StartUs;		// CopyTrace::nowUs()
+	qint64 DurationUs;
+	QString Arg;		// path the span worked on, may be empty
+	int ThreadId;		// thread that recorded it, a ring outlives its threads
+	TraceEvent() : Name(nullptr), StartUs(0), DurationUs(0), ThreadId(0) {}
+};
+
+/// hot path tracing.
+/// spans are kept in a ring per thread, the oldest are overwritten when a
+/// ring is full. the ring of a finished thread keeps its spans and is handed
+/// to the next new thread, so short-lived pool threads do not add rings; every
+/// thread gets an id of its own, the old spans keep the name of their thread.
+/// while disabled a span costs one atomic load.
+class CopyTrace
+{
+public:
+	static CopyTrace* instance();
+	static bool enabled() { return s_enabled.load() != 0; }
+	void setEnabled(bool enable);
+
+	// microseconds since the process started tracing
+	qint64 nowUs() const { return m_clock.nsecsElapsed() / 1000; }
+	void record(const char* name, qint64 startUs, qint64 durationUs, const QString& arg);
+	void clear();
+
+	// Chrome trace event JSON of the spans that overlap [fromUs, toUs],
+	// loads in chrome://tracing and Perfetto
+	QByteArray toChromeJson(qint64 fromUs, qint64 toUs) const;
+
+private:
+	CopyTrace();
+	struct Buffer
+	{
+		QMutex Lock;	// only contended while dumping
+		QVector<TraceEvent> Events;
+		int Next;
+		bool Wrapped;
+		int ThreadId;	// thread currently recording into the ring
+	};
+	// owned by the thread local storage, returns the ring when the thread ends
+	struct Lease
+	{
+		QSharedPointer<Buffer> Ring;
+		~Lease();
+	};
+	Buffer* localBuffer();
+
+	static QAtomicInt s_enabled;
+	QElapsedTimer m_clock;
+	qint64 m_epochMs;	// wall clock of m_clock start
+	QThreadStorage<Lease*> m_local;
+	mutable QMutex m_buffersLock;
+	QList<QSharedPointer<Buffer> > m_buffers;
+	QList<QSharedPointer<Buffer> > m_freeBuffers;	// rings of finished threads
+	QHash<int, QString> m_threadNames;				// thread id -> name
+	int m_nextThreadId;
+};
+
+/// records the enclosing scope as a span when tracing is enabled
+class TraceSpan
+{
+public:
+	explicit TraceSpan(const char* name)
+		: m_name(nullptr), m_arg(nullptr)
+	{
+		begin(name);
+	}
+	// arg must outlive the span
+	TraceSpan(const char* name, const QString& arg)
+		: m_name(nullptr), m_arg(&arg)
+	{
+		begin(name);
+	}
+	~TraceSpan()
+	{
+		if (m_name)
+		{
+			CopyTrace* trace = CopyTrace::instance();
+			trace->record(m_name, m_startUs, trace->nowUs() - m_startUs,
+				m_arg ? *m_arg : QString());
+		}
+	}
+private:
+	void begin(const char* name)
+	{
+		if (CopyTrace::enabled())
+		{
+			m_name = name;
+			m_startUs = CopyTrace::instance()->nowUs();
+		}
+	}
+	const char* m_name;
+	const QString* m_arg;
+	qint64 m_startUs;
+};
+
+#define COPYTRACE_CAT2(a, b) a##b
+#define COPYTRACE_CAT(a, b) COPYTRACE_CAT2(a, b)
+#define TRACE_SCOPE(name) TraceSpan COPYTRACE_CAT(traceSpan_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceSpan COPYTRACE_CAT(traceSpan_, __LINE__)(name, arg)
+
+#endif // COPYTRACE_H
@@ -0,0 +1,269 @@
+#include "fanotifywatcher.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QStorageInfo>
+#include "copytrace.h"
+
+#if defined(Q_OS_LINUX)
+#include <sys/fanotify.h>
+#endif
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+#define AUTOCOPY_HAVE_FANOTIFY
+#include <sys/statfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+// close_write covers created and rewritten files, create alone would report
+// files that are still being written
+static const quint64 kFanotifyMask = FAN_CLOSE_WRITE | FAN_MOVED_TO | FAN_MOVED_FROM
+	| FAN_DELETE | FAN_ONDIR;
+static const int kFanotifyBufferBytes = 64 * 1024;
+// directories seen in events, most are outside the watched ones
+static const int kDirCacheEntries = 4096;
+#endif
+
+FanotifyWatcher::FanotifyWatcher(QObject* parent)
+	: QThread(parent)
+	, m_fd(-1)
+{
+	m_stopPipe[0] = m_stopPipe[1] = -1;
+	setObjectName("fanotify");
+}
+
+FanotifyWatcher::~FanotifyWatcher()
+{
+	stop();
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	for (int fd : m_mountFds)
+		::close(fd);
+	if (m_fd >= 0)
+		::close(m_fd);
+	if (m_stopPipe[0] >= 0)
+	{
+		::close(m_stopPipe[0]);
+		::close(m_stopPipe[1]);
+	}
+#endif
+}
+
+bool FanotifyWatcher::open()
+{
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	m_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_REPORT_DFID_NAME, O_RDONLY | O_LARGEFILE);
+	if (m_fd < 0)
+	{
+		m_error = QString("fanotify_init: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+		return false;
+	}
+	if (pipe(m_stopPipe) != 0)
+	{
+		m_error = QString("pipe: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+		return false;
+	}
+	this->start(QThread::HighPriority);
+	return true;
+#else
+	m_error = "fanotify is not available on this platform";
+	return false;
+#endif
+}
+
+void FanotifyWatcher::stop()
+{
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	if (!isRunning())
+		return;
+	char wake = 0;
+	if (::write(m_stopPipe[1], &wake, 1) != 1)
+		return;
+	wait();
+#endif
+}
+
+bool FanotifyWatcher::addDirectory(const QString& dir)
+{
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	if (m_fd < 0)
+		return false;
+	QString canonical = QFileInfo(dir).canonicalFilePath();
+	if (canonical.isEmpty())
+		return false;
+	QString root = QStorageInfo(canonical).rootPath();
+	QMutexLocker locker(&m_lock);
+	if (!m_mountFsids.contains(root))
+	{
+		QByteArray path = QFile::encodeName(root);
+		if (fanotify_mark(m_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, kFanotifyMask, AT_FDCWD,
+			path.constData()) != 0)
+			return false;
+		int mountFd = ::open(path.constData(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+		struct statfs st;
+		if (mountFd < 0 || fstatfs(mountFd, &st) != 0)
+		{
+			if (mountFd >= 0)
+				::close(mountFd);
+			return false;
+		}
+		QByteArray fsid((const char*)&st.f_fsid, sizeof(st.f_fsid));
+		m_mountFsids.insert(root, fsid);
+		if (m_mountFds.contains(fsid))
+			::close(mountFd);
+		else
+			m_mountFds.insert(fsid, mountFd);
+	}
+	m_dirs.insert(canonical, QDir::cleanPath(dir));
+	return true;
+#else
+	Q_UNUSED(dir);
+	return false;
+#endif
+}
+
+void FanotifyWatcher::removeDirectories(const QStringList& dirs)
+{
+	// the marks stay, their cost does not depend on the number of directories
+	// matched by the path as added, a removed directory has no canonical path
+	QSet<QString> removed;
+	for (int i = 0; i < dirs.size(); i++)
+		removed.insert(QDir::cleanPath(dirs.at(i)));
+	QMutexLocker locker(&m_lock);
+	for (QHash<QString, QString>::iterator it = m_dirs.begin(); it != m_dirs.end();)
+	{
+		if (removed.contains(it.value()))
+			it = m_dirs.erase(it);
+		else
+			++it;
+	}
+}
+
+QStringList FanotifyWatcher::directories() const
+{
+	QMutexLocker locker(&m_lock);
+	return m_dirs.values();
+}
+
+QString FanotifyWatcher::resolveDirectory(const QByteArray& fsid, const QByteArray& handle)
+{
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	QByteArray key = fsid + handle;
+	QHash<QByteArray, QString>::const_iterator cached = m_dirCache.find(key);
+	if (cached != m_dirCache.end())
+		return cached.value();
+	int mountFd;
+	{
+		QMutexLocker locker(&m_lock);
+		mountFd = m_mountFds.value(fsid, -1);
+	}
+	if (mountFd < 0)
+		return QString();
+	QByteArray handleCopy = handle;
+	int fd = open_by_handle_at(mountFd, (struct file_handle*)handleCopy.data(), O_PATH | O_CLOEXEC);
+	if (fd < 0)
+		return QString();
+	char link[64];
+	snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+	char target[4096];
+	ssize_t length = readlink(link, target, sizeof(target) - 1);
+	::close(fd);
+	if (length <= 0)
+		return QString();
+	QString path = QFile::decodeName(QByteArray(target, int(length)));
+	if (m_dirCache.size() >= kDirCacheEntries)
+		m_dirCache.clear();
+	m_dirCache.insert(key, path);
+	return path;
+#else
+	Q_UNUSED(fsid);
+	Q_UNUSED(handle);
+	return QString();
+#endif
+}
+
+void FanotifyWatcher::handleEvents(const char* buffer, qint64 length)
+{
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	const struct fanotify_event_metadata* meta = (const struct fanotify_event_metadata*)buffer;
+	for (; FAN_EVENT_OK(meta, length); meta = FAN_EVENT_NEXT(meta, length))
+	{
+		if (meta->vers != FANOTIFY_METADATA_VERSION)
+			return;
+		if (meta->mask & FAN_Q_OVERFLOW)
+		{
+			emit overflowed();
+			continue;
+		}
+		const struct fanotify_event_info_fid* info = (const struct fanotify_event_info_fid*)(meta + 1);
+		if ((const char*)info >= (const char*)meta + meta->event_len
+			|| info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+			continue;
+		const struct file_handle* fh = (const struct file_handle*)info->handle;
+		QByteArray fsid((const char*)&info->fsid, sizeof(info->fsid));
+		QByteArray handle((const char*)fh, int(sizeof(*fh) + fh->handle_bytes));
+		const char* name = (const char*)fh->f_handle + fh->handle_bytes;
+
+		// a renamed or deleted directory leaves stale cached paths behind
+		if (meta->mask & FAN_ONDIR)
+		{
+			if (meta->mask & (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE))
+				m_dirCache.clear();
+			continue;
+		}
+		QString dir = resolveDirectory(fsid, handle);
+		if (dir.isEmpty())
+			continue;
+		{
+			QMutexLocker locker(&m_lock);
+			dir = m_dirs.value(dir);
+		}
+		if (dir.isEmpty())
+			continue;
+		TRACE_SCOPE_ARG("fanotify.event", dir);
+		if (meta->mask & (FAN_CLOSE_WRITE | FAN_MOVED_TO))
+			emit fileChanged(dir + "/" + QFile::decodeName(name));
+		if (meta->mask & (FAN_DELETE | FAN_MOVED_FROM))
+			emit directoryChanged(dir);
+	}
+#else
+	Q_UNUSED(buffer);
+	Q_UNUSED(length);
+#endif
+}
+
+void FanotifyWatcher::run()
+{
+#ifdef AUTOCOPY_HAVE_FANOTIFY
+	QByteArray buffer(kFanotifyBufferBytes, Qt::Uninitialized);
+	struct pollfd fds[2];
+	fds[0].fd = m_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = m_stopPipe[0];
+	fds[1].events = POLLIN;
+	while (true)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents)
+			break;
+		if (!(fds[0].revents & POLLIN))
+			continue;
+		ssize_t length = ::read(m_fd, buffer.data(), buffer.size());
+		if (length < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			break;
+		}
+		handleEvents(buffer.constData(), length);
+	}
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef FANOTIFYWATCHER_H
+#define FANOTIFYWATCHER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QStringList>
+
+/// mount-wide change notifications through fanotify (Linux 5.9+, needs
+/// CAP_SYS_ADMIN). one FAN_MARK_FILESYSTEM mark per file system replaces the
+/// per-directory watches, events carry the parent directory handle and the
+/// entry name (FAN_REPORT_DFID_NAME) and are filtered against the watched
+/// directories in user space. the signals match QFileSystemWatcher: files
+/// written or moved in are reported by fileChanged, deletes and moves out by
+/// directoryChanged. elsewhere open() fails and the watcher stays unused.
+class FanotifyWatcher : public QThread
+{
+	Q_OBJECT
+public:
+	FanotifyWatcher(QObject* parent = nullptr);
+	~FanotifyWatcher();
+
+	bool open();
+	void stop();
+	QString errorString() const { return m_error; }
+
+	// marks the file system of dir on first use, false if it cannot be marked
+	bool addDirectory(const QString& dir);
+	void removeDirectories(const QStringList& dirs);
+	QStringList directories() const;
+
+signals:
+	void directoryChanged(const QString& path);
+	void fileChanged(const QString& path);
+	// the kernel queue overflowed, events of every directory may be lost
+	void overflowed();
+
+protected:
+	void run();
+
+private:
+	QString resolveDirectory(const QByteArray& fsid, const QByteArray& handle);
+	void handleEvents(const char* buffer, qint64 length);
+
+	int m_fd;
+	int m_stopPipe[2];
+	QString m_error;
+
+	mutable QMutex m_lock;
+	// canonical path -> path as added. events resolve to canonical paths and
+	// are reported with the path the caller watches
+	QHash<QString, QString> m_dirs;
+	QHash<QString, QByteArray> m_mountFsids;	// mount root -> fsid
+	QHash<QByteArray, int> m_mountFds;			// fsid -> open mount root
+	// fsid + directory handle -> path, reader thread only, dropped when full
+	QHash<QByteArray, QString> m_dirCache;
+};
+
+#endif // FANOTIFYWATCHER_H
@@ -0,0 +1,161 @@
+#include "fasthash.h"
+#include <string.h>
+
+static const quint64 kPrime1 = Q_UINT64_C(11400714785074694791);
+static const quint64 kPrime2 = Q_UINT64_C(14029467366897019727);
+static const quint64 kPrime3 = Q_UINT64_C(1609587929392839161);
+static const quint64 kPrime4 = Q_UINT64_C(9650029242287828579);
+static const quint64 kPrime5 = Q_UINT64_C(2870177450012600261);
+
+static inline quint64 rotl64(quint64 x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// little endian reads, memcpy keeps unaligned access legal
+static inline quint64 read64(const char* p)
+{
+	quint64 v;
+	memcpy(&v, p, 8);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	v = qbswap(v);
+#endif
+	return v;
+}
+
+static inline quint32 read32(const char* p)
+{
+	quint32 v;
+	memcpy(&v, p, 4);
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	v = qbswap(v);
+#endif
+	return v;
+}
+
+static inline quint64 round64(quint64 acc, quint64 input)
+{
+	acc += input * kPrime2;
+	acc = rotl64(acc, 31);
+	return acc * kPrime1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+	acc ^= round64(0, val);
+	return acc * kPrime1 + kPrime4;
+}
+
+XxHash64::XxHash64(quint64 seed)
+{
+	reset(seed);
+}
+
+void XxHash64::reset(quint64 seed)
+{
+	m_seed = seed;
+	m_v[0] = seed + kPrime1 + kPrime2;
+	m_v[1] = seed + kPrime2;
+	m_v[2] = seed;
+	m_v[3] = seed - kPrime1;
+	m_total = 0;
+	m_memSize = 0;
+}
+
+void XxHash64::update(const char* data, qint64 len)
+{
+	if (len <= 0)
+		return;
+	const char* p = data;
+	const char* end = data + len;
+	m_total += quint64(len);
+
+	if (m_memSize + len < 32)
+	{
+		memcpy(m_mem + m_memSize, p, size_t(len));
+		m_memSize += int(len);
+		return;
+	}
+	if (m_memSize)
+	{
+		int fill = 32 - m_memSize;
+		memcpy(m_mem + m_memSize, p, fill);
+		m_v[0] = round64(m_v[0], read64(m_mem));
+		m_v[1] = round64(m_v[1], read64(m_mem + 8));
+		m_v[2] = round64(m_v[2], read64(m_mem + 16));
+		m_v[3] = round64(m_v[3], read64(m_mem + 24));
+		p += fill;
+		m_memSize = 0;
+	}
+	if (end - p >= 32)
+	{
+		quint64 v1 = m_v[0], v2 = m_v[1], v3 = m_v[2], v4 = m_v[3];
+		const char* limit = end - 32;
+		do
+		{
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		m_v[0] = v1; m_v[1] = v2; m_v[2] = v3; m_v[3] = v4;
+	}
+	if (p < end)
+	{
+		memcpy(m_mem, p, size_t(end - p));
+		m_memSize = int(end - p);
+	}
+}
+
+quint64 XxHash64::digest() const
+{
+	quint64 h;
+	if (m_total >= 32)
+	{
+		h = rotl64(m_v[0], 1) + rotl64(m_v[1], 7) + rotl64(m_v[2], 12) + rotl64(m_v[3], 18);
+		h = mergeRound(h, m_v[0]);
+		h = mergeRound(h, m_v[1]);
+		h = mergeRound(h, m_v[2]);
+		h = mergeRound(h, m_v[3]);
+	}
+	else
+	{
+		h = m_seed + kPrime5;
+	}
+	h += m_total;
+
+	const char* p = m_mem;
+	const char* end = m_mem + m_memSize;
+	while (p + 8 <= end)
+	{
+		h ^= round64(0, read64(p));
+		h = rotl64(h, 27) * kPrime1 + kPrime4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= quint64(read32(p)) * kPrime1;
+		h = rotl64(h, 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= quint64(quint8(*p)) * kPrime5;
+		h = rotl64(h, 11) * kPrime1;
+		++p;
+	}
+	h ^= h >> 33;
+	h *= kPrime2;
+	h ^= h >> 29;
+	h *= kPrime3;
+	h ^= h >> 32;
+	return h;
+}
+
+quint64 XxHash64::hash(const char* data, qint64 len, quint64 seed)
+{
+	XxHash64 state(seed);
+	state.update(data, len);
+	return state.digest();
+}
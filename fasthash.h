@@ -0,0 +1,27 @@
+#ifndef FASTHASH_H
+#define FASTHASH_H
+
+#include <QtGlobal>
+
+/// streaming XXH64.
+/// four independent accumulators are updated per 32 byte stripe, so the
+/// hash keeps up with memory bandwidth and is cheap next to disk I/O.
+class XxHash64
+{
+public:
+	explicit XxHash64(quint64 seed = 0);
+	void reset(quint64 seed = 0);
+	void update(const char* data, qint64 len);
+	quint64 digest() const;
+
+	static quint64 hash(const char* data, qint64 len, quint64 seed = 0);
+
+private:
+	quint64 m_v[4];
+	quint64 m_seed;
+	quint64 m_total;
+	char m_mem[32];
+	int m_memSize;
+};
+
+#endif // FASTHASH_H
@@ -0,0 +1,252 @@
+#ifndef GROUPQUEUE_H
+#define GROUPQUEUE_H
+
+#include <QQueue>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QElapsedTimer>
+#include "BlockingQueue.h"
+
+class QRunnable;
+
+/// one lane of the copy queue, a rule group
+struct QueueShare
+{
+	QString Name;
+	int Parent;			// index of the parent lane, -1 at the top
+	int Weight;			// share of the dequeues relative to the other lanes
+	qint64 RateLimit;	// bytes per second, 0 for unlimited
+	QueueShare() : Parent(-1), Weight(1), RateLimit(0) {}
+};
+
+/// element of the copy queue. Cost is charged to the rate limit of the lane
+/// and of every lane above it
+struct QueuedTask
+{
+	QRunnable* Task;
+	int Group;
+	qint64 Cost;
+	QueuedTask() : Task(nullptr), Group(0), Cost(0) {}
+	QueuedTask(QRunnable* task, int group, qint64 cost) : Task(task), Group(group), Cost(cost) {}
+};
+
+/// container for BlockingQueue with one FIFO per lane.
+/// lanes take turns by smooth weighted round robin, so a busy lane only gets
+/// its share. a lane whose token bucket, or that of a lane above it, is in
+/// debt is skipped until the bucket refills; buckets hold at most one second
+/// of their rate. lane 0 always exists and is unlimited.
+template <typename T>
+class WeightedQueue
+{
+public:
+	WeightedQueue() : m_size(0)
+	{
+		m_clock.start();
+		m_lanes.resize(1);
+	}
+
+	void setShares(const QVector<QueueShare>& shares)
+	{
+		QVector<Lane> lanes(qMax(1, shares.size()));
+		QHash<QString, int> index;
+		for (int i = 0; i < shares.size(); ++i)
+		{
+			lanes[i].Share = shares.at(i);
+			index.insert(shares.at(i).Name, i);
+		}
+		// queued tasks follow their lane by name, lanes that are gone hand
+		// their tasks to lane 0
+		for (int i = 0; i < m_lanes.size(); ++i)
+		{
+			int to = index.value(m_lanes.at(i).Share.Name, -1);
+			if (to >= 0)
+			{
+				lanes[to].Tokens = m_lanes.at(i).Tokens;
+				lanes[to].RefillMs = m_lanes.at(i).RefillMs;
+			}
+			else
+			{
+				to = 0;
+			}
+			Lane& lane = lanes[to];
+			while (!m_lanes[i].Items.isEmpty())
+			{
+				T t = m_lanes[i].Items.dequeue();
+				t.Group = to;
+				lane.Items.enqueue(t);
+			}
+		}
+		m_lanes = lanes;
+	}
+
+	void enqueue(const T& t)
+	{
+		T item = t;
+		if (item.Group < 0 || item.Group >= m_lanes.size())
+			item.Group = 0;
+		m_lanes[item.Group].Items.enqueue(item);
+		++m_size;
+	}
+
+	T dequeue()
+	{
+		qint64 now = m_clock.elapsed();
+		int total = 0;
+		int best = -1;
+		for (int i = 0; i < m_lanes.size(); ++i)
+		{
+			Lane& lane = m_lanes[i];
+			if (lane.Items.isEmpty() || !ready(i, now))
+				continue;
+			lane.Current += qMax(1, lane.Share.Weight);
+			total += qMax(1, lane.Share.Weight);
+			if (best < 0 || lane.Current > m_lanes.at(best).Current)
+				best = i;
+		}
+		// every lane is throttled, take from the first one that has tasks
+		if (best < 0)
+		{
+			for (int i = 0; i < m_lanes.size() && best < 0; ++i)
+			{
+				if (!m_lanes.at(i).Items.isEmpty())
+					best = i;
+			}
+		}
+		if (best < 0)
+			return T();
+		m_lanes[best].Current -= total;
+		T t = m_lanes[best].Items.dequeue();
+		--m_size;
+		for (int i = best; i >= 0 && i < m_lanes.size(); i = m_lanes.at(i).Share.Parent)
+		{
+			Lane& lane = m_lanes[i];
+			if (lane.Share.RateLimit <= 0)
+				continue;
+			lane.Tokens = tokens(lane, now) - double(t.Cost);
+			lane.RefillMs = now;
+		}
+		return t;
+	}
+
+	bool isEmpty() const { return m_size == 0; }
+	int size() const { return m_size; }
+
+	void clear()
+	{
+		for (int i = 0; i < m_lanes.size(); ++i)
+		{
+			m_lanes[i].Items.clear();
+			m_lanes[i].Current = 0;
+		}
+		m_size = 0;
+	}
+
+	// every queued item, throttled lanes included, and empties the queue
+	QList<T> takeAll()
+	{
+		QList<T> items;
+		for (int i = 0; i < m_lanes.size(); ++i)
+			items << m_lanes.at(i).Items;
+		clear();
+		return items;
+	}
+
+	int laneSize(int group) const
+	{
+		return group >= 0 && group < m_lanes.size() ? m_lanes.at(group).Items.size() : 0;
+	}
+
+	// capacity split by weight, every lane keeps a few slots. the lanes add
+	// up to at most capacity, so the lanes all stay below their share before
+	// the queue is full
+	int laneCapacity(int group, int capacity) const
+	{
+		int total = 0;
+		for (int i = 0; i < m_lanes.size(); ++i)
+			total += qMax(1, m_lanes.at(i).Share.Weight);
+		if (group < 0 || group >= m_lanes.size() || total <= 0)
+			return capacity;
+		int reserved = qMin(4, capacity / m_lanes.size());
+		int shared = capacity - reserved * m_lanes.size();
+		return reserved + shared * qMax(1, m_lanes.at(group).Share.Weight) / total;
+	}
+
+	// a lane has tasks and is not throttled
+	bool hasReady() const
+	{
+		if (m_size == 0)
+			return false;
+		qint64 now = m_clock.elapsed();
+		for (int i = 0; i < m_lanes.size(); ++i)
+		{
+			if (!m_lanes.at(i).Items.isEmpty() && ready(i, now))
+				return true;
+		}
+		return false;
+	}
+
+private:
+	struct Lane
+	{
+		QueueShare Share;
+		QQueue<T> Items;
+		int Current;		// smooth weighted round robin state
+		double Tokens;
+		qint64 RefillMs;
+		Lane() : Current(0), Tokens(0), RefillMs(0) {}
+	};
+
+	double tokens(const Lane& lane, qint64 now) const
+	{
+		double rate = double(lane.Share.RateLimit);
+		return qMin(rate, lane.Tokens + rate * double(now - lane.RefillMs) / 1000.0);
+	}
+
+	bool ready(int index, qint64 now) const
+	{
+		for (int i = index; i >= 0 && i < m_lanes.size(); i = m_lanes.at(i).Share.Parent)
+		{
+			const Lane& lane = m_lanes.at(i);
+			if (lane.Share.RateLimit > 0 && tokens(lane, now) < 0)
+				return false;
+		}
+		return true;
+	}
+
+	QVector<Lane> m_lanes;
+	int m_size;
+	QElapsedTimer m_clock;
+};
+
+/// the copy queue of AutoCopySchedule: BlockingQueue over WeightedQueue.
+/// take() treats a queue whose tasks are all throttled as empty.
+class GroupQueue : public BlockingQueue<QueuedTask, WeightedQueue>
+{
+public:
+	using BlockingQueue<QueuedTask, WeightedQueue>::isFull;
+
+	void setShares(const QVector<QueueShare>& shares)
+	{
+		QWriteLocker locker(&lock);
+		queue.setShares(shares);
+	}
+	// removes every task without waiting, also those of throttled lanes, so
+	// the caller can delete them
+	QList<QueuedTask> takeAll()
+	{
+		QWriteLocker locker(&lock);
+		return queue.takeAll();
+	}
+	// the lane of group used up its part of the capacity
+	bool isFull(int group) const
+	{
+		QReadLocker locker(&lock);
+		return queue.laneSize(group) >= queue.laneCapacity(group, cap);
+	}
+
+protected:
+	bool checkEmpty() const { return !queue.hasReady(); }
+};
+
+#endif // GROUPQUEUE_H
@@ -0,0 +1,38 @@
+#include "metricsserver.h"
+#include <QTcpSocket>
+#include <QHostAddress>
+#include "autocopyschedule.h"
+
+MetricsServer::MetricsServer(AutoCopySchedule* schedule, QObject* parent)
+	: QTcpServer(parent)
+	, m_schedule(schedule)
+{
+	connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+bool MetricsServer::listenLocal(quint16 port)
+{
+	return listen(QHostAddress::LocalHost, port);
+}
+
+void MetricsServer::onNewConnection()
+{
+	while (QTcpSocket* socket = nextPendingConnection())
+	{
+		connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+		// answer as soon as the request line arrived, the path is not checked
+		connect(socket, &QTcpSocket::readyRead, [=]()
+		{
+			if (!socket->canReadLine())
+				return;
+			socket->readAll();
+			QByteArray body = CopyMetrics::toPrometheus(m_schedule->metricsSnapshot());
+			QByteArray response = "HTTP/1.0 200 OK\r\n"
+				"Content-Type: text/plain; version=0.0.4\r\n"
+				"Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+				"Connection: close\r\n\r\n";
+			socket->write(response + body);
+			socket->disconnectFromHost();
+		});
+	}
+}
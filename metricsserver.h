@@ -0,0 +1,24 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QTcpServer>
+
+class AutoCopySchedule;
+
+/// minimal HTTP endpoint answering every request with the Prometheus text
+/// of the schedule metrics, bound to localhost only
+class MetricsServer : public QTcpServer
+{
+	Q_OBJECT
+public:
+	MetricsServer(AutoCopySchedule* schedule, QObject* parent = nullptr);
+	bool listenLocal(quint16 port);
+
+private slots:
+	void onNewConnection();
+
+private:
+	AutoCopySchedule* m_schedule;
+};
+
+#endif // METRICSSERVER_H
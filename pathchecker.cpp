@@ -0,0 +1,144 @@
+#include "pathchecker.h"
+#include <QFileInfo>
+#include <QRunnable>
+#include <QStringList>
+#include "copytrace.h"
+
+static const qint64 kMissingTtlMs = 10000;
+static const int kCheckThreads = 4;
+
+class PathCheckTask : public QRunnable
+{
+public:
+	PathCheckTask(PathChecker* checker, const QString& path, quint32 ticket)
+		: m_checker(checker), m_path(path), m_ticket(ticket)
+	{
+		setAutoDelete(true);
+	}
+	void run()
+	{
+		TRACE_SCOPE_ARG("PathChecker::check", m_path);
+		QFileInfo info(m_path);
+		PathChecker::State state = info.isDir() ? PathChecker::IS_DIR
+			: info.isFile() ? PathChecker::IS_FILE : PathChecker::MISSING;
+		m_checker->post(m_path, m_ticket, state);
+	}
+private:
+	PathChecker* m_checker;
+	QString m_path;
+	quint32 m_ticket;
+};
+
+static QString parentOf(const QString& path)
+{
+	return QFileInfo(path).path();
+}
+
+PathChecker::PathChecker(QObject* parent)
+	: QObject(parent)
+	, m_nextTicket(1)
+	, m_deliverQueued(false)
+{
+	m_pool.setMaxThreadCount(kCheckThreads);
+	m_clock.start();
+}
+
+PathChecker::~PathChecker()
+{
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+PathChecker::State PathChecker::state(const QString& path)
+{
+	if (path.isEmpty())
+		return MISSING;
+	QHash<QString, Entry>::const_iterator it = m_cache.find(path);
+	if (it == m_cache.end())
+	{
+		if (!m_pending.contains(path))
+			check(path);
+		return UNKNOWN;
+	}
+	if (it.value().Result == MISSING && !m_pending.contains(path)
+		&& m_clock.elapsed() - it.value().CheckedMs >= kMissingTtlMs)
+		check(path);
+	return it.value().Result;
+}
+
+void PathChecker::check(const QString& path)
+{
+	quint32 ticket = m_nextTicket++;
+	m_pending.insert(path, ticket);
+	m_pool.start(new PathCheckTask(this, path, ticket));
+}
+
+void PathChecker::invalidate(const QString& path)
+{
+	QStringList paths = m_children.values(path);
+	paths << path;
+	for each (const QString& p in paths)
+	{
+		// a check that is still running may have looked before the change
+		if (m_cache.contains(p) || m_pending.contains(p))
+			check(p);
+	}
+}
+
+void PathChecker::clear()
+{
+	m_pool.clear();
+	m_cache.clear();
+	m_children.clear();
+	m_pending.clear();
+}
+
+void PathChecker::post(const QString& path, quint32 ticket, State state)
+{
+	QMutexLocker locker(&m_lock);
+	CheckResult result;
+	result.Path = path;
+	result.Ticket = ticket;
+	result.Result = state;
+	m_results << result;
+	if (!m_deliverQueued)
+	{
+		m_deliverQueued = true;
+		QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+	}
+}
+
+void PathChecker::deliver()
+{
+	QList<CheckResult> results;
+	{
+		QMutexLocker locker(&m_lock);
+		results.swap(m_results);
+		m_deliverQueued = false;
+	}
+	qint64 now = m_clock.elapsed();
+	QStringList changed;
+	for each (const CheckResult& result in results)
+	{
+		// superseded by a later check, or dropped by clear()
+		QHash<QString, quint32>::iterator pending = m_pending.find(result.Path);
+		if (pending == m_pending.end() || pending.value() != result.Ticket)
+			continue;
+		m_pending.erase(pending);
+		QHash<QString, Entry>::iterator cached = m_cache.find(result.Path);
+		if (cached == m_cache.end())
+		{
+			cached = m_cache.insert(result.Path, Entry());
+			m_children.insert(parentOf(result.Path), result.Path);
+			changed << result.Path;
+		}
+		else if (cached.value().Result != result.Result)
+		{
+			changed << result.Path;
+		}
+		cached.value().Result = result.Result;
+		cached.value().CheckedMs = now;
+	}
+	if (!changed.isEmpty())
+		emit checked(changed);
+}
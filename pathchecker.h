@@ -0,0 +1,78 @@
+#ifndef PATHCHECKER_H
+#define PATHCHECKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <QMultiHash>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QStringList>
+
+/// existence checks of rule paths on a small pool of its own, so a slow or
+/// unreachable network drive cannot stall the GUI thread.
+/// state() answers from the cache; an unknown path is queued and checked()
+/// follows with the paths whose results changed, several results share one
+/// signal. paths that
+/// exist stay cached until a watcher event invalidates them, missing paths are
+/// checked again when asked after a few seconds, a destination may appear
+/// without any event. used on the GUI thread only, the pool threads just hand
+/// back results.
+class PathChecker : public QObject
+{
+	Q_OBJECT
+public:
+	enum State
+	{
+		UNKNOWN,
+		MISSING,
+		IS_FILE,
+		IS_DIR
+	};
+
+	PathChecker(QObject* parent = nullptr);
+	~PathChecker();
+
+	State state(const QString& path);
+	// checks path, and the cached entries directly below it, again. the old
+	// results stay until the new ones are in
+	void invalidate(const QString& path);
+	void clear();
+
+	// a result handed over by a pool thread
+	void post(const QString& path, quint32 ticket, State state);
+
+signals:
+	void checked(const QStringList& paths);
+
+private slots:
+	void deliver();
+
+private:
+	struct Entry
+	{
+		State Result;
+		qint64 CheckedMs;
+	};
+	struct CheckResult
+	{
+		QString Path;
+		quint32 Ticket;
+		State Result;
+	};
+
+	void check(const QString& path);
+
+	QThreadPool m_pool;
+	QElapsedTimer m_clock;
+	QHash<QString, Entry> m_cache;
+	QMultiHash<QString, QString> m_children;	// parent directory -> cached paths
+	QHash<QString, quint32> m_pending;			// path -> ticket of its running check
+	quint32 m_nextTicket;
+
+	QMutex m_lock;
+	QList<CheckResult> m_results;
+	bool m_deliverQueued;
+};
+
+#endif // PATHCHECKER_H
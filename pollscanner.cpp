@@ -0,0 +1,277 @@
+#include "pollscanner.h"
+#include <QDir>
+#include <QFile>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+#include <QStorageInfo>
+#include "copymetrics.h"
+#include "copytrace.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#endif
+
+/// one due directory, listed and compared on a pool thread
+struct ScanJob
+{
+	QString Dir;
+	PollScanner::Listing Previous;
+	PollScanner::Listing Current;
+	bool First;
+	bool Ok;
+	bool ListChanged;		// files added or removed
+	QStringList Modified;
+};
+
+class ScanTask : public QRunnable
+{
+public:
+	ScanTask(ScanJob* job) : m_job(job) { setAutoDelete(true); }
+	void run()
+	{
+		TRACE_SCOPE_ARG("PollScanner::scan", m_job->Dir);
+		m_job->Ok = PollScanner::scan(m_job->Dir, m_job->Current);
+		if (!m_job->Ok || m_job->First)
+			return;
+		m_job->ListChanged = m_job->Current.size() != m_job->Previous.size();
+		for (PollScanner::Listing::const_iterator it = m_job->Current.begin();
+			it != m_job->Current.end(); ++it)
+		{
+			PollScanner::Listing::const_iterator old = m_job->Previous.find(it.key());
+			if (old == m_job->Previous.end())
+				m_job->ListChanged = true;
+			else if (old.value().Size != it.value().Size
+				|| old.value().ModifiedTicks != it.value().ModifiedTicks)
+				m_job->Modified << m_job->Dir + "/" + it.key();
+		}
+	}
+private:
+	ScanJob* m_job;
+};
+
+PollScanner::PollScanner(qint64 minIntervalMs, qint64 maxIntervalMs, bool pollAll,
+	CopyMetrics* metrics, QObject* parent)
+	: QThread(parent)
+	, m_minIntervalMs(qMax<qint64>(100, minIntervalMs))
+	, m_maxIntervalMs(qMax(minIntervalMs, maxIntervalMs))
+	, m_pollAll(pollAll)
+	, m_metrics(metrics)
+	, m_stop(false)
+{
+	m_clock.start();
+	setObjectName("poll scanner");
+	this->start(QThread::LowPriority);
+}
+
+PollScanner::~PollScanner()
+{
+	stop();
+}
+
+void PollScanner::stop()
+{
+	{
+		QMutexLocker locker(&m_lock);
+		m_stop = true;
+		m_wake.wakeOne();
+	}
+	wait();
+}
+
+void PollScanner::addPath(const QString& dir)
+{
+	QMutexLocker locker(&m_lock);
+	if (m_dirs.contains(dir))
+		return;
+	PolledDir polled;
+	polled.IntervalMs = m_minIntervalMs;
+	polled.DueMs = 0;
+	polled.Scanned = false;
+	m_dirs.insert(dir, polled);
+	m_wake.wakeOne();
+}
+
+void PollScanner::watch(const QString& dir)
+{
+	{
+		QMutexLocker locker(&m_lock);
+		if (m_dirs.contains(dir) || m_notified.contains(dir))
+			return;
+	}
+	if (m_pollAll || needsPolling(dir))
+	{
+		addPath(dir);
+		return;
+	}
+	QMutexLocker locker(&m_lock);
+	m_notified.insert(dir);
+}
+
+void PollScanner::removePaths(const QStringList& dirs)
+{
+	QMutexLocker locker(&m_lock);
+	for each (const QString& dir in dirs)
+	{
+		m_dirs.remove(dir);
+		m_notified.remove(dir);
+	}
+}
+
+QStringList PollScanner::directories() const
+{
+	QMutexLocker locker(&m_lock);
+	return m_dirs.keys();
+}
+
+bool PollScanner::needsPolling(const QString& dir)
+{
+	QString path = QDir(dir).absolutePath();
+#ifdef Q_OS_WIN
+	if (path.startsWith("//"))
+		return true;
+	QString root = QDir::toNativeSeparators(path.left(3));
+	return GetDriveTypeW((const wchar_t*)root.utf16()) == DRIVE_REMOTE;
+#else
+	QByteArray type = QStorageInfo(path).fileSystemType();
+	return type.startsWith("nfs") || type == "cifs" || type == "smbfs" || type == "smb3"
+		|| type.startsWith("fuse") || type == "9p";
+#endif
+}
+
+bool PollScanner::scan(const QString& dir, Listing& listing)
+{
+	listing.clear();
+#ifdef Q_OS_WIN
+	// FindExInfoBasic skips short names, size and time come with the listing
+	WIN32_FIND_DATAW data;
+	QString pattern = QDir::toNativeSeparators(dir + "/*");
+	HANDLE h = FindFirstFileExW((const wchar_t*)pattern.utf16(), FindExInfoBasic, &data,
+		FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+	if (h == INVALID_HANDLE_VALUE)
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	do
+	{
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		Entry entry;
+		entry.Size = (qint64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		entry.ModifiedTicks = (qint64(data.ftLastWriteTime.dwHighDateTime) << 32)
+			| data.ftLastWriteTime.dwLowDateTime;
+		listing.insert(QString::fromWCharArray(data.cFileName), entry);
+	} while (FindNextFileW(h, &data));
+	FindClose(h);
+	return true;
+#else
+	// fstatat relative to the open directory, no full path lookup per entry
+	DIR* d = opendir(QFile::encodeName(dir).constData());
+	if (!d)
+		return false;
+	int fd = dirfd(d);
+	while (struct dirent* ent = readdir(d))
+	{
+		struct stat st;
+		if (fstatat(fd, ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		Entry entry;
+		entry.Size = st.st_size;
+		entry.ModifiedTicks = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+		listing.insert(QFile::decodeName(ent->d_name), entry);
+	}
+	closedir(d);
+	return true;
+#endif
+}
+
+void PollScanner::run()
+{
+	QThreadPool pool;
+	pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+	while (true)
+	{
+		QVector<ScanJob*> jobs;
+		{
+			QMutexLocker locker(&m_lock);
+			if (m_stop)
+				break;
+			qint64 now = m_clock.elapsed();
+			qint64 next = now + m_maxIntervalMs;
+			for (QHash<QString, PolledDir>::const_iterator it = m_dirs.begin(); it != m_dirs.end(); ++it)
+			{
+				if (it.value().DueMs > now)
+				{
+					next = qMin(next, it.value().DueMs);
+					continue;
+				}
+				ScanJob* job = new ScanJob;
+				job->Dir = it.key();
+				job->Previous = it.value().Files;
+				job->First = !it.value().Scanned;
+				job->Ok = false;
+				job->ListChanged = false;
+				jobs << job;
+			}
+			if (jobs.isEmpty())
+			{
+				m_wake.wait(&m_lock, (unsigned long)(next - now));
+				continue;
+			}
+		}
+
+		for each (ScanJob* job in jobs)
+			pool.start(new ScanTask(job));
+		pool.waitForDone();
+
+		for each (ScanJob* job in jobs)
+		{
+			if (job->ListChanged)
+				emit directoryChanged(job->Dir);
+			for each (const QString& file in job->Modified)
+				emit fileChanged(file);
+		}
+
+		QMutexLocker locker(&m_lock);
+		qint64 now = m_clock.elapsed();
+		int changed = 0;
+		for each (ScanJob* job in jobs)
+		{
+			QHash<QString, PolledDir>::iterator it = m_dirs.find(job->Dir);
+			// removed while it was scanned
+			if (it == m_dirs.end())
+			{
+				delete job;
+				continue;
+			}
+			PolledDir& polled = it.value();
+			bool hasChanges = job->ListChanged || !job->Modified.isEmpty();
+			if (job->Ok)
+			{
+				polled.Files = job->Current;
+				polled.Scanned = true;
+			}
+			// busy directories are polled more often, quiet ones back off
+			if (hasChanges)
+			{
+				changed++;
+				polled.IntervalMs = qMax(m_minIntervalMs, polled.IntervalMs / 2);
+			}
+			else
+			{
+				polled.IntervalMs = qMin(m_maxIntervalMs, polled.IntervalMs + polled.IntervalMs / 2);
+			}
+			polled.DueMs = now + polled.IntervalMs;
+			delete job;
+		}
+		if (m_metrics)
+		{
+			m_metrics->increment("poll_scans", jobs.size());
+			if (changed > 0)
+				m_metrics->increment("poll_changes", changed);
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef POLLSCANNER_H
+#define POLLSCANNER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QElapsedTimer>
+
+class CopyMetrics;
+
+/// change detection by polling, for directories on file systems that deliver
+/// no notifications (NFS, SMB, FUSE).
+/// every directory has its own interval: halved when a scan finds changes,
+/// grown by half when it finds none, kept within [minIntervalMs, maxIntervalMs].
+/// only the directories that are due are listed, in parallel. the signals
+/// match QFileSystemWatcher so the same slots consume both.
+class PollScanner : public QThread
+{
+	Q_OBJECT
+public:
+	// pollAll polls every directory, otherwise only those needsPolling() picks
+	PollScanner(qint64 minIntervalMs, qint64 maxIntervalMs, bool pollAll,
+		CopyMetrics* metrics = nullptr, QObject* parent = nullptr);
+	~PollScanner();
+
+	// the first scan of a directory only records its files
+	void addPath(const QString& dir);
+	// addPath if the directory needs polling, decided once per directory
+	void watch(const QString& dir);
+	void removePaths(const QStringList& dirs);
+	QStringList directories() const;
+	void stop();
+
+	// true for remote and FUSE mounts
+	static bool needsPolling(const QString& dir);
+
+	// file name -> size and last write time
+	struct Entry
+	{
+		qint64 Size;
+		qint64 ModifiedTicks;
+	};
+	typedef QHash<QString, Entry> Listing;
+	// one pass over the directory, metadata comes with the listing where the
+	// platform allows it
+	static bool scan(const QString& dir, Listing& listing);
+
+signals:
+	void directoryChanged(const QString& path);
+	void fileChanged(const QString& path);
+
+protected:
+	void run();
+
+private:
+	struct PolledDir
+	{
+		Listing Files;
+		qint64 IntervalMs;
+		qint64 DueMs;
+		bool Scanned;
+	};
+
+	qint64 m_minIntervalMs;
+	qint64 m_maxIntervalMs;
+	bool m_pollAll;
+	CopyMetrics* m_metrics;
+	QElapsedTimer m_clock;
+
+	mutable QMutex m_lock;
+	QWaitCondition m_wake;
+	QHash<QString, PolledDir> m_dirs;
+	QSet<QString> m_notified;	// directories left to the watcher
+	bool m_stop;
+};
+
+#endif // POLLSCANNER_H
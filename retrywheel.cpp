@@ -0,0 +1,90 @@
+#include "retrywheel.h"
+
+// 256 slots of 100 ms, one revolution is 25.6 s
+static const int kWheelSlots = 256;
+static const qint64 kWheelTickMs = 100;
+
+RetryWheel::RetryWheel(qint64 baseDelayMs, qint64 maxDelayMs, int maxAttempts)
+	: m_slots(kWheelSlots)
+	, m_lastTick(-1)
+	, m_baseDelayMs(qMax(kWheelTickMs, baseDelayMs))
+	, m_maxDelayMs(qMax(baseDelayMs, maxDelayMs))
+	, m_maxAttempts(qMax(1, maxAttempts))
+{
+}
+
+qint64 RetryWheel::tickMs() const
+{
+	return kWheelTickMs;
+}
+
+qint64 RetryWheel::schedule(const QString& path, qint64 nowMs)
+{
+	int attempt = m_attempts.value(path) + 1;
+	if (attempt > m_maxAttempts)
+	{
+		cancel(path);
+		return -1;
+	}
+	m_attempts.insert(path, attempt);
+
+	qint64 delay = m_baseDelayMs;
+	for (int i = 1; i < attempt && delay < m_maxDelayMs; ++i)
+		delay *= 2;
+	delay = qMin(delay, m_maxDelayMs);
+
+	scheduleAt(path, nowMs + delay, nowMs);
+	return delay;
+}
+
+void RetryWheel::scheduleAt(const QString& path, qint64 dueMs, qint64 nowMs)
+{
+	// a newer entry replaces the pending one, the old entry is ignored
+	// when its slot comes round
+	Entry entry;
+	entry.Path = path;
+	entry.DueMs = dueMs;
+	if (m_lastTick < 0)
+		m_lastTick = nowMs / kWheelTickMs;
+	// an entry in the past is picked up by the next advance
+	qint64 tick = qMax(dueMs / kWheelTickMs, m_lastTick + 1);
+	m_slots[int(tick % kWheelSlots)].append(entry);
+	m_due.insert(path, entry.DueMs);
+}
+
+void RetryWheel::cancel(const QString& path)
+{
+	m_attempts.remove(path);
+	m_due.remove(path);
+}
+
+void RetryWheel::advance(qint64 nowMs, QStringList& due)
+{
+	if (m_lastTick < 0)
+		return;
+	qint64 nowTick = nowMs / kWheelTickMs;
+	// after a long stall every slot is visited once
+	qint64 first = qMax(m_lastTick + 1, nowTick - kWheelSlots + 1);
+	for (qint64 tick = first; tick <= nowTick; ++tick)
+	{
+		QVector<Entry>& slot = m_slots[int(tick % kWheelSlots)];
+		for (int i = 0; i < slot.size();)
+		{
+			const Entry& entry = slot.at(i);
+			QHash<QString, qint64>::iterator it = m_due.find(entry.Path);
+			bool live = it != m_due.end() && it.value() == entry.DueMs;
+			if (live && entry.DueMs > nowMs)
+			{
+				++i;	// a later round
+				continue;
+			}
+			if (live)
+			{
+				due << entry.Path;
+				m_due.erase(it);
+			}
+			slot.remove(i);
+		}
+	}
+	m_lastTick = nowTick;
+}
@@ -0,0 +1,51 @@
+#ifndef RETRYWHEEL_H
+#define RETRYWHEEL_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+
+/// delayed retries of sources that could not be copied.
+/// a hashed timer wheel: every slot covers one tick, entries further away
+/// than a revolution stay in their slot until their round comes. the delay
+/// doubles with every attempt of a path up to maxDelayMs, after maxAttempts
+/// the path is given up. scheduleAt() puts a path on the wheel at a fixed
+/// time without counting attempts, for copies deferred by a sync policy.
+/// not thread safe, only used by the copy thread.
+class RetryWheel
+{
+public:
+	RetryWheel(qint64 baseDelayMs, qint64 maxDelayMs, int maxAttempts);
+
+	// delay until the retry, -1 if the attempts are used up
+	qint64 schedule(const QString& path, qint64 nowMs);
+	// due at dueMs, replaces a pending entry of the path
+	void scheduleAt(const QString& path, qint64 dueMs, qint64 nowMs);
+	// forget the attempts of a path that was copied
+	void cancel(const QString& path);
+	// paths whose retry is due at nowMs
+	void advance(qint64 nowMs, QStringList& due);
+
+	bool isEmpty() const { return m_due.isEmpty(); }
+	bool contains(const QString& path) const { return m_due.contains(path); }
+	int pending() const { return m_due.size(); }
+	int attempts(const QString& path) const { return m_attempts.value(path); }
+	qint64 tickMs() const;
+
+private:
+	struct Entry
+	{
+		QString Path;
+		qint64 DueMs;
+	};
+	QVector<QVector<Entry> > m_slots;
+	QHash<QString, qint64> m_due;		// path -> due time of its live entry
+	QHash<QString, int> m_attempts;
+	qint64 m_lastTick;
+	qint64 m_baseDelayMs;
+	qint64 m_maxDelayMs;
+	int m_maxAttempts;
+};
+
+#endif // RETRYWHEEL_H
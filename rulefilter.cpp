@@ -0,0 +1,166 @@
+#include "rulefilter.h"
+
+#if defined(Q_OS_WIN)
+static const QRegularExpression::PatternOptions kGlobOptions =
+	QRegularExpression::CaseInsensitiveOption | QRegularExpression::DontCaptureOption;
+#else
+static const QRegularExpression::PatternOptions kGlobOptions =
+	QRegularExpression::DontCaptureOption;
+#endif
+
+RuleFilter::RuleFilter()
+	: m_hasInclude(false)
+	, m_hasExclude(false)
+{
+}
+
+RuleFilter::RuleFilter(const QStringList& includes, const QStringList& excludes)
+	: m_include(compile(includes, false))
+	, m_exclude(compile(excludes, true))
+	, m_hasInclude(!includes.isEmpty())
+	, m_hasExclude(!excludes.isEmpty())
+{
+}
+
+bool RuleFilter::isEmpty() const
+{
+	return !m_hasInclude && !m_hasExclude;
+}
+
+bool RuleFilter::accept(const QString& relativePath) const
+{
+	if (m_hasExclude && m_exclude.match(relativePath).hasMatch())
+		return false;
+	if (m_hasInclude && !m_include.match(relativePath).hasMatch())
+		return false;
+	return true;
+}
+
+bool RuleFilter::acceptDir(const QString& relativePath) const
+{
+	if (relativePath.isEmpty() || !m_hasExclude)
+		return true;
+	return !m_exclude.match(relativePath).hasMatch();
+}
+
+QStringList RuleFilter::splitPatterns(const QString& text)
+{
+	QStringList patterns;
+	foreach(const QString& p, text.split(QRegularExpression("[;,]"), QString::SkipEmptyParts))
+	{
+		QString glob = p.trimmed();
+		glob.replace("\\", "/");
+		if (!glob.isEmpty() && !patterns.contains(glob))
+			patterns << glob;
+	}
+	return patterns;
+}
+
+QString RuleFilter::joinPatterns(const QStringList& patterns)
+{
+	return patterns.join(";");
+}
+
+QString RuleFilter::globToRegex(const QString& glob)
+{
+	QString rx;
+	const int n = glob.size();
+	for (int i = 0; i < n; ++i)
+	{
+		const QChar c = glob.at(i);
+		if (c == '*')
+		{
+			if (i + 1 < n && glob.at(i + 1) == '*')
+			{// "**/" also matches no directory at all
+				++i;
+				if (i + 1 < n && glob.at(i + 1) == '/')
+				{
+					++i;
+					rx += "(?:.*/)?";
+				}
+				else
+					rx += ".*";
+			}
+			else
+				rx += "[^/]*";
+		}
+		else if (c == '?')
+		{
+			rx += "[^/]";
+		}
+		else if (c == '[')
+		{
+			// "[!...]" negates, a ']' right after the opening is part of the set
+			int start = i + 1;
+			bool negate = start < n && glob.at(start) == '!';
+			if (negate)
+				++start;
+			int end = glob.indexOf(']', start + 1);
+			if (end < 0)
+			{
+				// "[]" and "[!]" are no sets, the bracket is literal
+				rx += "\\[";
+				continue;
+			}
+			QString set;
+			for (int k = start; k < end; ++k)
+			{
+				const QChar s = glob.at(k);
+				if (s == '/')
+					continue;
+				if (s == '\\' || s == '[' || s == ']' || s == '^')
+					set += '\\';
+				set += s;
+			}
+			// a set never matches the separator, also not through a range
+			if (negate)
+				rx += "[^/" + set + "]";
+			else if (set.isEmpty())
+				rx += "(?!)";
+			else
+				rx += "(?!/)[" + set + "]";
+			i = end;
+		}
+		else
+		{
+			rx += QRegularExpression::escape(QString(c));
+		}
+	}
+	return rx;
+}
+
+QRegularExpression RuleFilter::compile(const QStringList& globs, bool anyComponent)
+{
+	QStringList names, paths;
+	foreach(const QString& glob, globs)
+	{
+		QString g = glob;
+		while (g.startsWith("/"))
+			g.remove(0, 1);
+		if (g.isEmpty())
+			continue;
+		// a pattern that does not compile, a reversed range, is matched
+		// literally instead of breaking the whole list
+		QString rx = globToRegex(g);
+		if (!QRegularExpression(rx).isValid())
+			rx = QRegularExpression::escape(g);
+		if (g.contains('/'))
+			paths << rx;
+		else
+			names << rx;
+	}
+
+	// one alternation for all patterns of the list
+	QStringList branches;
+	const QString tail = anyComponent ? "(?:/|$)" : "$";
+	if (!names.isEmpty())
+		branches << QString("(?:^|/)(?:%1)%2").arg(names.join("|")).arg(tail);
+	if (!paths.isEmpty())
+		branches << QString("^(?:%1)%2").arg(paths.join("|")).arg(tail);
+	if (branches.isEmpty())
+		return QRegularExpression();
+
+	QRegularExpression rx(branches.join("|"), kGlobOptions);
+	rx.optimize();
+	return rx;
+}
@@ -0,0 +1,41 @@
+#ifndef RULEFILTER_H
+#define RULEFILTER_H
+
+#include <QStringList>
+#include <QRegularExpression>
+
+/// include/exclude glob lists of one rule.
+/// every list is compiled into a single regular expression, so a path is
+/// checked against all of its patterns in one pass.
+///  - a pattern without '/' is tested against path components
+///    ("*.tmp", ".git"): includes against the file name, excludes against
+///    every component so a whole directory can be skipped
+///  - a pattern with '/' is tested against the path relative to the rule
+///    source, "**" crosses directories
+class RuleFilter
+{
+public:
+	RuleFilter();
+	RuleFilter(const QStringList& includes, const QStringList& excludes);
+
+	bool isEmpty() const;
+	// relativePath is relative to the rule source ("sub/a.dll")
+	bool accept(const QString& relativePath) const;
+	// directories are only tested against the exclude list
+	bool acceptDir(const QString& relativePath) const;
+
+	// "*.dll; *.pdb" <-> ("*.dll", "*.pdb")
+	static QStringList splitPatterns(const QString& text);
+	static QString joinPatterns(const QStringList& patterns);
+
+private:
+	static QString globToRegex(const QString& glob);
+	static QRegularExpression compile(const QStringList& globs, bool anyComponent);
+
+	QRegularExpression m_include;
+	QRegularExpression m_exclude;
+	bool m_hasInclude;
+	bool m_hasExclude;
+};
+
+#endif // RULEFILTER_H
@@ -0,0 +1,130 @@
+#include "rulesearchindex.h"
+
+RuleSearchIndex::RuleSearchIndex()
+{
+}
+
+void RuleSearchIndex::trigrams(const QString& lowerText, QVector<quint64>& grams)
+{
+	grams.clear();
+	const int n = lowerText.size();
+	if (n < 3)
+		return;
+	grams.reserve(n - 2);
+	const QChar* s = lowerText.constData();
+	for (int i = 0; i + 2 < n; ++i)
+	{
+		grams << (quint64(s[i].unicode()) << 32 | quint64(s[i + 1].unicode()) << 16
+			| quint64(s[i + 2].unicode()));
+	}
+}
+
+void RuleSearchIndex::add(quint32 id, const QString& key, const QString& value)
+{
+	if (m_texts.contains(id))
+		remove(id);
+	// '\n' never appears in a query, no match spans key and value
+	QString text = (key + '\n' + value).toLower();
+	QVector<quint64> grams;
+	trigrams(text, grams);
+	for (int i = 0; i < grams.size(); ++i)
+		m_postings[grams.at(i)].insert(id);
+	m_texts.insert(id, text);
+	if (!m_query.isEmpty() && text.contains(m_query))
+		m_matches.insert(id);
+}
+
+void RuleSearchIndex::remove(quint32 id)
+{
+	QHash<quint32, QString>::iterator it = m_texts.find(id);
+	if (it == m_texts.end())
+		return;
+	QVector<quint64> grams;
+	trigrams(it.value(), grams);
+	for (int i = 0; i < grams.size(); ++i)
+	{
+		QHash<quint64, QSet<quint32> >::iterator posting = m_postings.find(grams.at(i));
+		if (posting == m_postings.end())
+			continue;
+		posting.value().remove(id);
+		if (posting.value().isEmpty())
+			m_postings.erase(posting);
+	}
+	m_texts.erase(it);
+	m_matches.remove(id);
+}
+
+void RuleSearchIndex::clear()
+{
+	m_texts.clear();
+	m_postings.clear();
+	m_matches.clear();
+}
+
+void RuleSearchIndex::candidates(QVector<quint32>& ids) const
+{
+	QVector<quint64> grams;
+	trigrams(m_query, grams);
+	if (grams.isEmpty())
+	{// too short for a trigram, every rule is a candidate
+		ids.reserve(m_texts.size());
+		for (QHash<quint32, QString>::const_iterator it = m_texts.begin(); it != m_texts.end(); ++it)
+			ids << it.key();
+		return;
+	}
+	// walk the shortest list, the others are only probed
+	QVector<const QSet<quint32>*> lists;
+	const QSet<quint32>* shortest = nullptr;
+	for (int i = 0; i < grams.size(); ++i)
+	{
+		QHash<quint64, QSet<quint32> >::const_iterator posting = m_postings.find(grams.at(i));
+		if (posting == m_postings.end())
+			return;
+		lists << &posting.value();
+		if (!shortest || posting.value().size() < shortest->size())
+			shortest = &posting.value();
+	}
+	for each (quint32 id in *shortest)
+	{
+		bool all = true;
+		for (int i = 0; i < lists.size() && all; ++i)
+			all = lists.at(i) == shortest || lists.at(i)->contains(id);
+		if (all)
+			ids << id;
+	}
+}
+
+void RuleSearchIndex::setQuery(const QString& query)
+{
+	QString lower = query.toLower();
+	if (lower == m_query)
+		return;
+	bool narrows = !m_query.isEmpty() && lower.contains(m_query);
+	m_query = lower;
+	if (m_query.isEmpty())
+	{
+		m_matches.clear();
+		return;
+	}
+
+	QVector<quint32> ids;
+	if (narrows)
+	{
+		ids.reserve(m_matches.size());
+		for each (quint32 id in m_matches)
+			ids << id;
+	}
+	else
+	{
+		candidates(ids);
+	}
+	// trigrams only narrow down, the text decides
+	QSet<quint32> matches;
+	matches.reserve(ids.size());
+	for (int i = 0; i < ids.size(); ++i)
+	{
+		if (m_texts.value(ids.at(i)).contains(m_query))
+			matches.insert(ids.at(i));
+	}
+	m_matches.swap(matches);
+}
@@ -0,0 +1,41 @@
+#ifndef RULESEARCHINDEX_H
+#define RULESEARCHINDEX_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+/// search index of the rule view: case-insensitive substring search over the
+/// key and value text of every rule, rules known by their RuleStore id.
+/// each trigram (three UTF-16 units, packed exactly) lists the rules that
+/// contain it, so a query only verifies the rules that have all of its
+/// trigrams. a query that extends the previous one verifies the previous
+/// matches only. rules added or changed while a query is active are tested
+/// against it right away, so the match set never has to be rebuilt.
+class RuleSearchIndex
+{
+public:
+	RuleSearchIndex();
+
+	// adds the rule, or replaces its text
+	void add(quint32 id, const QString& key, const QString& value);
+	void remove(quint32 id);
+	// drops the rules, the query stays
+	void clear();
+
+	// an empty query matches every rule
+	void setQuery(const QString& query);
+	bool matches(quint32 id) const { return m_query.isEmpty() || m_matches.contains(id); }
+
+private:
+	static void trigrams(const QString& lowerText, QVector<quint64>& grams);
+	void candidates(QVector<quint32>& ids) const;
+
+	QHash<quint32, QString> m_texts;				// id -> lower case "key\nvalue"
+	QHash<quint64, QSet<quint32> > m_postings;		// trigram -> ids
+	QString m_query;								// lower case
+	QSet<quint32> m_matches;
+};
+
+#endif // RULESEARCHINDEX_H
@@ -0,0 +1,151 @@
+#include "rulestore.h"
+
+RuleStore::RuleStore()
+{
+	clear();
+}
+
+int RuleStore::intern(const QString& text)
+{
+	if (text.isEmpty())
+		return 0;
+	QHash<QString, int>::const_iterator it = m_poolIds.find(text);
+	if (it != m_poolIds.end())
+		return it.value();
+	int id = m_pool.size();
+	m_pool << text;
+	m_poolIds.insert(text, id);
+	return id;
+}
+
+void RuleStore::insert(int row, const AutoCopyProperty& prop)
+{
+	row = qBound(0, row, size());
+	for (int i = 0; i < TEXT_COUNT; ++i)
+		m_text[i].insert(row, 0);
+	m_keyTypes.insert(row, 0);
+	m_valueTypes.insert(row, 0);
+	m_flags.insert(row, 0);
+	m_ids.insert(row, m_nextId++);
+	set(row, prop);
+}
+
+void RuleStore::remove(int row, int count)
+{
+	for (int i = 0; i < TEXT_COUNT; ++i)
+		m_text[i].remove(row, count);
+	m_keyTypes.remove(row, count);
+	m_valueTypes.remove(row, count);
+	m_flags.remove(row, count);
+	m_ids.remove(row, count);
+}
+
+void RuleStore::clear()
+{
+	for (int i = 0; i < TEXT_COUNT; ++i)
+		m_text[i].clear();
+	m_keyTypes.clear();
+	m_valueTypes.clear();
+	m_flags.clear();
+	m_ids.clear();
+	m_nextId = 1;
+	m_pool.clear();
+	m_poolIds.clear();
+	m_pool << QString();
+}
+
+void RuleStore::set(int row, const AutoCopyProperty& prop)
+{
+	m_text[KEY][row] = intern(prop.Key);
+	m_text[HELP][row] = intern(prop.Help);
+	m_text[GROUP][row] = intern(prop.Group);
+	m_text[POLICY][row] = intern(prop.Policy);
+	setList(row, STRINGS, prop.Strings);
+	setList(row, INCLUDES, prop.Includes);
+	setList(row, EXCLUDES, prop.Excludes);
+	setList(row, PUBLISH_ORDER, prop.PublishOrder);
+	m_keyTypes[row] = quint8(prop.KeyType);
+	m_valueTypes[row] = quint8(prop.ValueType);
+
+	quint8 flags = 0;
+	if (prop.Advanced)
+		flags |= ADVANCED;
+	if (prop.Compress)
+		flags |= COMPRESS;
+	if (prop.Mirror)
+		flags |= MIRROR;
+	if (prop.Transaction)
+		flags |= TRANSACTION;
+	if (prop.ValueType == AutoCopyProperty::BOOL)
+	{
+		if (prop.Value.toBool())
+			flags |= CHECKED;
+		m_text[VALUE][row] = 0;
+	}
+	else
+	{
+		m_text[VALUE][row] = intern(prop.Value.toString());
+	}
+	m_flags[row] = flags;
+}
+
+AutoCopyProperty RuleStore::at(int row) const
+{
+	AutoCopyProperty prop;
+	prop.Key = text(row, KEY);
+	prop.Help = text(row, HELP);
+	prop.KeyType = keyType(row);
+	prop.ValueType = valueType(row);
+	prop.Value = value(row);
+	prop.Advanced = flag(row, ADVANCED);
+	prop.Strings = list(row, STRINGS);
+	prop.Includes = list(row, INCLUDES);
+	prop.Excludes = list(row, EXCLUDES);
+	prop.Compress = flag(row, COMPRESS);
+	prop.Mirror = flag(row, MIRROR);
+	prop.Group = text(row, GROUP);
+	prop.Policy = text(row, POLICY);
+	prop.Transaction = flag(row, TRANSACTION);
+	prop.PublishOrder = list(row, PUBLISH_ORDER);
+	return prop;
+}
+
+AutoCopyPropertyList RuleStore::properties() const
+{
+	AutoCopyPropertyList props;
+	props.reserve(size());
+	for (int row = 0; row < size(); ++row)
+		props << at(row);
+	return props;
+}
+
+void RuleStore::setText(int row, Text column, const QString& text)
+{
+	m_text[column][row] = intern(text);
+}
+
+QStringList RuleStore::list(int row, Text column) const
+{
+	const QString& joined = text(row, column);
+	return joined.isEmpty() ? QStringList() : joined.split('\n');
+}
+
+void RuleStore::setList(int row, Text column, const QStringList& list)
+{
+	m_text[column][row] = intern(list.join('\n'));
+}
+
+void RuleStore::setFlag(int row, Flag f, bool on)
+{
+	if (on)
+		m_flags[row] |= f;
+	else
+		m_flags[row] &= quint8(~f);
+}
+
+QVariant RuleStore::value(int row) const
+{
+	if (valueType(row) == AutoCopyProperty::BOOL)
+		return flag(row, CHECKED);
+	return text(row, VALUE);
+}
@@ -0,0 +1,101 @@
+#ifndef RULESTORE_H
+#define RULESTORE_H
+
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include "autocopy.h"
+
+/// the rules of AutoRuleModel, one array per field instead of one item per
+/// cell. text fields hold ids into a string pool, so a directory or
+/// destination shared by many rules is stored once and the per-rule cost is a
+/// few ints; lists are pooled joined by '\n'. booleans are bits of one flag
+/// byte. every member is implicitly shared, a copy is O(1) and stays valid
+/// while the model changes, which is how the schedule snapshots the rules.
+/// the pool only grows until clear().
+class RuleStore
+{
+public:
+	enum Text
+	{
+		KEY,
+		VALUE,
+		HELP,
+		GROUP,
+		POLICY,
+		STRINGS,
+		INCLUDES,
+		EXCLUDES,
+		PUBLISH_ORDER,
+		TEXT_COUNT
+	};
+	enum Flag
+	{
+		ADVANCED = 0x01,
+		COMPRESS = 0x02,
+		MIRROR = 0x04,
+		TRANSACTION = 0x08,
+		CHECKED = 0x10		// value of a BOOL rule
+	};
+
+	RuleStore();
+
+	int size() const { return m_flags.size(); }
+	bool isEmpty() const { return m_flags.isEmpty(); }
+
+	void insert(int row, const AutoCopyProperty& prop);
+	void remove(int row, int count = 1);
+	void clear();
+
+	AutoCopyProperty at(int row) const;
+	void set(int row, const AutoCopyProperty& prop);
+	AutoCopyPropertyList properties() const;
+
+	const QString& text(int row, Text column) const
+	{
+		return m_pool.at(m_text[column].at(row));
+	}
+	void setText(int row, Text column, const QString& text);
+	// pool ids compare like the texts, -1 if text is not in the pool
+	int textId(int row, Text column) const { return m_text[column].at(row); }
+	int poolId(const QString& text) const { return text.isEmpty() ? 0 : m_poolIds.value(text, -1); }
+	// the list fields, STRINGS, INCLUDES, EXCLUDES and PUBLISH_ORDER
+	QStringList list(int row, Text column) const;
+	void setList(int row, Text column, const QStringList& list);
+
+	bool flag(int row, Flag f) const { return (m_flags.at(row) & f) != 0; }
+	void setFlag(int row, Flag f, bool on);
+
+	AutoCopyProperty::PropertyType keyType(int row) const
+	{
+		return static_cast<AutoCopyProperty::PropertyType>(m_keyTypes.at(row));
+	}
+	AutoCopyProperty::PropertyType valueType(int row) const
+	{
+		return static_cast<AutoCopyProperty::PropertyType>(m_valueTypes.at(row));
+	}
+	void setKeyType(int row, AutoCopyProperty::PropertyType type) { m_keyTypes[row] = quint8(type); }
+	void setValueType(int row, AutoCopyProperty::PropertyType type) { m_valueTypes[row] = quint8(type); }
+
+	// the value as the model shows it, a bool for BOOL rules
+	QVariant value(int row) const;
+
+	// stable for the life of the rule, rows move as rules are inserted
+	quint32 id(int row) const { return m_ids.at(row); }
+
+private:
+	int intern(const QString& text);
+
+	QVector<int> m_text[TEXT_COUNT];
+	QVector<quint8> m_keyTypes;
+	QVector<quint8> m_valueTypes;
+	QVector<quint8> m_flags;
+	QVector<quint32> m_ids;
+	quint32 m_nextId;
+
+	QVector<QString> m_pool;			// id 0 is the empty string
+	QHash<QString, int> m_poolIds;
+};
+
+#endif // RULESTORE_H
@@ -0,0 +1,91 @@
+#include "syncpolicy.h"
+#include <QTime>
+
+static const qint64 kDayMs = 24 * 60 * 60 * 1000;
+
+SyncPolicy::SyncPolicy()
+	: m_mode(IMMEDIATE)
+	, m_intervalMs(0)
+	, m_windowStartMs(0)
+	, m_windowEndMs(0)
+{
+}
+
+bool SyncPolicy::parse(const QString& text, SyncPolicy& policy)
+{
+	policy = SyncPolicy();
+	QString spec = text.trimmed().toLower();
+	if (spec.isEmpty() || spec == "immediate")
+		return true;
+	QString kind = spec.section(':', 0, 0);
+	QString arg = spec.section(':', 1);
+	bool ok = false;
+	if (kind == "debounce" || kind == "batch")
+	{
+		qint64 ms = arg.toLongLong(&ok);
+		if (!ok || ms <= 0)
+			return false;
+		policy.m_mode = kind == "debounce" ? DEBOUNCED : BATCHED;
+		policy.m_intervalMs = ms;
+		return true;
+	}
+	if (kind == "window")
+	{
+		QTime start = QTime::fromString(arg.section('-', 0, 0).trimmed(), "H:mm");
+		QTime end = QTime::fromString(arg.section('-', 1, 1).trimmed(), "H:mm");
+		if (!start.isValid() || !end.isValid() || start == end)
+			return false;
+		policy.m_mode = WINDOW;
+		policy.m_windowStartMs = start.msecsSinceStartOfDay();
+		policy.m_windowEndMs = end.msecsSinceStartOfDay();
+		return true;
+	}
+	return false;
+}
+
+SyncPolicy SyncPolicy::parse(const QString& text)
+{
+	SyncPolicy policy;
+	parse(text, policy);
+	return policy;
+}
+
+QString SyncPolicy::toString() const
+{
+	switch (m_mode)
+	{
+	case DEBOUNCED:
+		return QString("debounce:%1").arg(m_intervalMs);
+	case BATCHED:
+		return QString("batch:%1").arg(m_intervalMs);
+	case WINDOW:
+		return QString("window:%1-%2")
+			.arg(QTime::fromMSecsSinceStartOfDay(m_windowStartMs).toString("HH:mm"))
+			.arg(QTime::fromMSecsSinceStartOfDay(m_windowEndMs).toString("HH:mm"));
+	default:
+		return "immediate";
+	}
+}
+
+qint64 SyncPolicy::delayMs(const QDateTime& now) const
+{
+	switch (m_mode)
+	{
+	case DEBOUNCED:
+		return m_intervalMs;
+	case BATCHED:
+		return m_intervalMs - now.toMSecsSinceEpoch() % m_intervalMs;
+	case WINDOW:
+	{
+		qint64 ms = now.time().msecsSinceStartOfDay();
+		bool inside = m_windowStartMs < m_windowEndMs ?
+			ms >= m_windowStartMs && ms < m_windowEndMs :
+			ms >= m_windowStartMs || ms < m_windowEndMs;
+		if (inside)
+			return 0;
+		return (m_windowStartMs - ms + kDayMs) % kDayMs;
+	}
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef SYNCPOLICY_H
+#define SYNCPOLICY_H
+
+#include <QString>
+#include <QDateTime>
+
+/// when the changes of a rule are copied.
+///  - "immediate" (or empty): as soon as the change is seen
+///  - "debounce:MS": once the file has been quiet for MS milliseconds
+///  - "batch:MS": at the next multiple of MS on the wall clock, all changes
+///    of the period are copied together
+///  - "window:HH:MM-HH:MM": only inside the daily window, the end may be
+///    past midnight ("window:22:00-06:00")
+/// a file changed several times before it is due is copied once.
+class SyncPolicy
+{
+public:
+	enum Mode { IMMEDIATE, DEBOUNCED, BATCHED, WINDOW };
+
+	SyncPolicy();
+	// false and an immediate policy if text is not understood
+	static bool parse(const QString& text, SyncPolicy& policy);
+	static SyncPolicy parse(const QString& text);
+	QString toString() const;
+
+	Mode mode() const { return m_mode; }
+	bool isImmediate() const { return m_mode == IMMEDIATE; }
+	// milliseconds from now until a change seen now may be copied
+	qint64 delayMs(const QDateTime& now) const;
+	// a new change moves the pending copy later instead of joining it
+	bool restartsOnChange() const { return m_mode == DEBOUNCED; }
+
+private:
+	Mode m_mode;
+	qint64 m_intervalMs;
+	int m_windowStartMs;	// since midnight
+	int m_windowEndMs;
+};
+
+#endif // SYNCPOLICY_H